@@ -40,36 +40,53 @@
 #ifndef _CREATEEDGES_TASK_H_
 #define _CREATEEDGES_TASK_H_
 
+#include <limits>
+
 #include "common.h"
+#include "GeometryView.h"
 
+// parallel_reduce body: creates one axis' edges and, since the triangle
+// bounds are at hand anyway, the scene extent along that axis
 class CreateEdges_task {
 public:
   v_BoxEdge_inplace &proxy;
   v_Triangle_aux &tris;
   KdTreeNode_inplace *node;
-  const std::vector<Triangle> &triangleList;
+  const GeometryView &geometry;
   uint axis; // which axis are we working on?
   uint axis_offset;
+  float lo, hi; // extent of the triangles seen so far
 
   CreateEdges_task(v_BoxEdge_inplace &proxy, v_Triangle_aux &tris,
-                  KdTreeNode_inplace *node, const std::vector<Triangle> &triangleList,
+                  KdTreeNode_inplace *node, const GeometryView &geometry,
                   uint axis, uint axis_offset)
-    : proxy(proxy), node(node), triangleList(triangleList),
-      tris(tris), axis(axis), axis_offset(axis_offset) {}
+    : proxy(proxy), node(node), geometry(geometry),
+      tris(tris), axis(axis), axis_offset(axis_offset),
+      lo(std::numeric_limits<float>::max()),
+      hi(-std::numeric_limits<float>::max()) {}
 
   CreateEdges_task(CreateEdges_task &other, tbb::split)
-    : proxy(other.proxy), node(other.node), triangleList(other.triangleList),
-      tris(other.tris), axis(other.axis), axis_offset(other.axis_offset) {}
+    : proxy(other.proxy), node(other.node), geometry(other.geometry),
+      tris(other.tris), axis(other.axis), axis_offset(other.axis_offset),
+      lo(std::numeric_limits<float>::max()),
+      hi(-std::numeric_limits<float>::max()) {}
+
+  void join(const CreateEdges_task &rhs) {
+    if (rhs.lo < lo) lo = rhs.lo;
+    if (rhs.hi > hi) hi = rhs.hi;
+  }
 
   // go from 0 to n per axis
-  void operator()(const tbb::blocked_range<size_t> &r) const {
+  void operator()(const tbb::blocked_range<size_t> &r) {
     for (size_t j=r.begin(); j<r.end(); j++) {
       size_t start = axis_offset+2*(j-axis_offset);
       size_t end = axis_offset+2*(j-axis_offset) + 1;
-      new (&proxy[start]) BoxEdge_inplace(triangleList[j-axis_offset].bound.min[axis],
-                                      j-axis_offset, START, axis);
-      new (&proxy[end]) BoxEdge_inplace(triangleList[j-axis_offset].bound.max[axis],
-                                    j-axis_offset, END, axis);
+      float bmin, bmax;
+      geometry.bounds(axis, j-axis_offset, bmin, bmax);
+      if (bmin < lo) lo = bmin;
+      if (bmax > hi) hi = bmax;
+      new (&proxy[start]) BoxEdge_inplace(bmin, j-axis_offset, START, axis);
+      new (&proxy[end]) BoxEdge_inplace(bmax, j-axis_offset, END, axis);
       // Triangle_aux layout [ Xs, Xe, Ys, Ye, Zs, Ze ]
       // just the index into the proxy array (which will be the same in tab/s)
       tris[j-axis_offset].edges[2*axis] = &proxy[start];
@@ -0,0 +1,71 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _FILL_TASK_H_
+#define _FILL_TASK_H_
+
+#include <tbb/task.h>
+
+// The final pass, over one chunk of the triangles: writes each into the
+// item range of every leaf it ended up in, from the chunk's offsets (see
+// leafOffsetsFor), so the leaves list their triangles in triangle order.
+class Fill_task : public tbb::task {
+public:
+  Fill_task(const v_Triangle_aux &tris, uint begin, uint end, uint *offsets,
+            int *items)
+    : tris(tris), begin(begin), end(end), offsets(offsets), items(items) {}
+
+  tbb::task *execute() {
+    for (uint i = begin; i < end; i++) {
+      const Triangle_aux &tri = tris[i];
+      for (uint j=0;j<tri.membership_size;j++) {
+        items[offsets[tri.membership[j]]++] = tri.triangleIndex;
+      }
+    }
+    return NULL;
+  }
+
+private:
+  const v_Triangle_aux &tris;
+  const uint begin, end;
+  uint *offsets; // [live node], this chunk's write cursors
+  int *items;
+};
+
+#endif // _FILL_TASK_H_
@@ -42,20 +42,23 @@
 
 #include "common_inplace.h"
 #include "PrescanTab.h"
+#include "Tracer.h"
 
 class FindBestPlane_AoS_prescan_task : public tbb::task {
 public:
   FindBestPlane_AoS_prescan_task(v_BoxEdge_inplace &boxEdges, v_Triangle_aux &tris,
                                  vp_KdTreeNode_inplace *live, PrescanTab *tab,
-                                 uint begin, uint end): 
+                                 uint begin, uint end, Tracer *tracer, uint level): 
     boxEdges(boxEdges), tris(tris), live(live), tab(tab),
-    begin(begin), end(end) {};
+    begin(begin), end(end), tracer(tracer), level(level) {};
 
   tbb::task *execute() {
+    TraceScope trace(tracer, "prescan", level, -1, end-begin);
+
     // doing this in reverse might improve temporal locality
     for (uint i=begin;i<end;i++) {
       for (uint j=0;j<boxEdges[i].tri->membership_size;j++) {
-        unsigned char l=boxEdges[i].tri->membership[j];
+        uint l=boxEdges[i].tri->membership[j];
         if (boxEdges[i].edgeType == END) {
           tab[l].nB++;
         }
@@ -73,6 +76,8 @@ private:
   const v_Triangle_aux &tris;
   const vp_KdTreeNode_inplace *const live;
   PrescanTab *tab;
+  Tracer *tracer;
+  const uint level;
 };
 
 #endif // _FINDBESTPLANE_AOS_PRESCAN_TASK_H_
@@ -45,18 +45,22 @@
 #include <tbb/task.h>
 
 #include "PrescanTab.h"
+#include "Tracer.h"
 
 class FindBestPlane_AoS_task : public tbb::task {
 public:
   FindBestPlane_AoS_task(const v_BoxEdge_inplace &boxEdges, const v_Triangle_aux &tris,
                          const vp_KdTreeNode_inplace *live, PrescanTab *tab, SplitMemo *memo,
-                         uint axis, uint begin, uint end, KdTreeAccel *accel):
+                         uint axis, uint begin, uint end, KdTreeAccel *accel,
+                         uint level):
     boxEdges(boxEdges), tris(tris), live(live), tab(tab), memo(memo), axis(axis),
-    begin(begin), end(end), accel(accel) {};
+    begin(begin), end(end), accel(accel), level(level) {};
 
   ~FindBestPlane_AoS_task() {};
 
   tbb::task *execute() {
+    TraceScope trace(accel->tracer(), "final scan", level, -1, end-begin);
+
     if (!tab) { // this means this is the first chunk -- no prescan needed
       tab = (PrescanTab*)scalable_calloc(live->size(), sizeof(PrescanTab));
     }
@@ -67,7 +71,7 @@ public:
     
     for (uint i=begin;i<end;i++) {
       for (uint j=0;j<boxEdges[i].tri->membership_size;j++) {
-        unsigned char l = boxEdges[i].tri->membership[j];
+        uint l = boxEdges[i].tri->membership[j];
         if (boxEdges[i].edgeType == END) {
           tab[l].nB++;
         }
@@ -97,6 +101,7 @@ private:
   PrescanTab *tab;
   SplitMemo *memo;
   const KdTreeAccel *accel;
+  const uint level;
 };
 
 #endif // _FINDBESTPLANE_AOS_TASK_H_
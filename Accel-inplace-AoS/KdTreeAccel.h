@@ -49,13 +49,9 @@
 
 class KdTreeAccel : public KdTreeAccel_base {
  public:
-  KdTreeAccel(TriangleMesh *mesh, uint numThreads, uint max_depth);
+  KdTreeAccel(const GeometryView &geometry, const BuildOptions &options);
 
-  ~KdTreeAccel() {
-//     if (kdTreeNodeObj) delete kdTreeNodeObj;
-//     kdTreeNodeObj = NULL;
-    kdTreeNodeObj->clear();
-  }
+  ~KdTreeAccel();
 
   // Mandatory functions
   void build();
@@ -77,11 +73,36 @@ private:
   void parallel_build(v_BoxEdge_inplace &boxEdges, v_Triangle_aux &tris, uint maxDepth);
 
   void findBestPlane(v_BoxEdge_inplace &boxEdges, v_Triangle_aux &tris,
-                     vp_KdTreeNode_inplace *live, SplitMemo *memo);
+                     vp_KdTreeNode_inplace *live, SplitMemo *memo, uint level);
   void classifyTriangles(v_Triangle_aux &tris, vp_KdTreeNode_inplace *live, 
-                         SplitMemo *memo, KdTreeNode_inplace *base);
+                         SplitMemo *memo, KdTreeNode_inplace *base, uint level);
+  // per-chunk write offsets for unsplit nodes (deterministic mode)
+  uint *leafOffsetsFor(const v_Triangle_aux &tris, vp_KdTreeNode_inplace *live);
   void fill(v_Triangle_aux &tris, vp_KdTreeNode_inplace *live);
-  void moveTriangles(KdTreeNode_inplace *node);
+  // --compact: sweep a copy of the edges, and tris, without the triangles
+  // that no live node holds any more (see Compact_task.h)
+  void compact(v_BoxEdge_inplace &boxEdges, v_BoxEdge_inplace *&edges,
+               v_Triangle_aux &tris);
+
+  // NEWGEN lays the tree out as it goes: a split node gets its pair of
+  // child slots (empty leaves until the children are decided), and a
+  // leaf its range of triangleCount items
+  uint packSplit(KdTreeNode_inplace *node);
+  void packLeaf(KdTreeNode_inplace *node);
+  // the same for all live nodes at once, in parallel: a prefix sum over
+  // them assigns the slots and the children's places in newLive; a NULL
+  // memo makes leaves of them all
+  void newGen(v_BoxEdge_inplace &boxEdges, vp_KdTreeNode_inplace *live,
+              SplitMemo *memo, vp_KdTreeNode_inplace *newLive);
+
+  // the tree so far, with the live nodes as leaves
+  void takeSnapshot(uint depth, const v_Triangle_aux &tris,
+                    const vp_KdTreeNode_inplace *live);
+
+  // free the nodes (and their index lists), e.g. before a rebuild
+  void releaseNodes();
+  // what a cancelled build does with what it has built so far
+  void discard();
 
   int begin_idx[3], end_idx[3];
 
@@ -92,6 +113,4 @@ private:
 
 void impl_usage();
 
-extern bool ver_splitedge;
-
 #endif // _KDTREEACCEL_H_
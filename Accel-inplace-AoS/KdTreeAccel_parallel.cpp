@@ -40,13 +40,21 @@
 #include <iomanip>
 #include <limits>
 
+#include <tbb/parallel_for.h>
+
 #include "KdTreeAccel.h"
-#include "options.h"
 #include "PrescanTab.h"
 #include "FindBestPlane_AoS_prescan_task.h"
 #include "FindBestPlane_AoS_task.h"
 #include "Split_task.h"
+#include "LeafCount_task.h"
+#include "NewGen_task.h"
+#include "MergeMemos_task.h"
+#include "Fill_task.h"
+#include "Compact_task.h"
 #include "timers.h"
+#include "Tracer.h"
+#include "PerfCounters.h"
 
 using namespace std;
 
@@ -61,7 +69,7 @@ void KdTreeAccel::parallel_build(v_BoxEdge_inplace &boxEdges, v_Triangle_aux &tr
     tris[i].membership[0] = 0;
   }
 
-  uint n = m_mesh->triangleList.size();
+  uint n = m_geometry.numTriangles();
 
   // x, y, z
   for (uint i=0;i<3;i++) {
@@ -69,22 +77,59 @@ void KdTreeAccel::parallel_build(v_BoxEdge_inplace &boxEdges, v_Triangle_aux &tr
     end_idx[i] = 2*n*(i+1);
   }
 
-  v_KdTreeNode_inplace &nodeObjs = *kdTreeNodeObj;
+  // what the level sweeps visit: boxEdges, until compact() drops some
+  v_BoxEdge_inplace *edges = &boxEdges;
+
   vp_KdTreeNode_inplace *live = new vp_KdTreeNode_inplace();
   live->push_back(root_);
 
   KdTreeNode_inplace *base = root_;
 
+  // --budget-ms: levels take about as long as the one before; stop when
+  // the time is spent, or before a level that won't fit in what is left
+  double levelStartMs = 0, levelMs = 0;
+
   // each iteration builds a level
-  for (uint level=0; level<maxDepth; level++) {
+  uint level;
+  for (level=0; level<maxDepth; level++) {
+
+    if (m_options.budgetMs) {
+      double left = budgetLeftMs();
+      levelMs = levelStartMs - left;
+      levelStartMs = left;
+      if (left <= 0 || (level > 0 && left < levelMs)) break;
+    }
+    if (checkCancel()) {
+      break;
+    }
+
+    // --compact: drop the triangles that are only in leaves by now
+    if (m_options.compactEvery && level > 0
+        && level % m_options.compactEvery == 0) {
+      RECORD_TIME(
+        stats.compact_usec[level][0],
+        stats.compact[level][0]);
+      TraceScope trace(m_tracer, "compact", level, -1, tris.size());
+      compact(boxEdges, edges, tris);
+      RECORD_TIME(
+        stats.compact_usec[level][1],
+        stats.compact[level][1]);
+    }
 
     // FindBestPlane
     RECORD_TIME(
       stats.findBestPlane_usec[level][0],
       stats.findBestPlane[level][0]);
 
-    SplitMemo memo[live->size()];
-    findBestPlane(boxEdges, tris, live, memo);
+    SplitMemo *memo = new SplitMemo[live->size()];
+    {
+      PerfScope perf(m_perf, PERF_FINDBESTPLANE);
+      findBestPlane(*edges, tris, live, memo, level);
+    }
+    if (checkCancel()) {
+      delete [] memo;
+      break;
+    }
 
     RECORD_TIME(
       stats.findBestPlane_usec[level][1],
@@ -94,44 +139,12 @@ void KdTreeAccel::parallel_build(v_BoxEdge_inplace &boxEdges, v_Triangle_aux &tr
     RECORD_TIME(
       stats.newGen_usec[level][0],
       stats.newGen[level][0]);
+    TraceScope newGenTrace(m_tracer, "newgen", level);
+    PerfScope newGenPerf(m_perf, PERF_NEWGEN);
     vp_KdTreeNode_inplace *newLive = new vp_KdTreeNode_inplace(); // next gen live
-    KdTreeNode_inplace *newNode;
-    uint frontier = index((*live)[live->size()-1], root_) + 1;
-    for(uint i=0;i<live->size();i++) {
-      // if it's worth splitting
-      if ((*live)[i]->triangleCount > 0 
-          && sah.m_Ci * (*live)[i]->triangleCount > memo[i].SAH) {
-        // set splitEdge
-        (*live)[i]->splitEdge = &boxEdges[memo[i].split];
-        
-        // pull two at the end and make them left and right for this kdTreeNode
-        // keep out the ones that are empty from newLive
-        // if nA of bestEdge for (*live)[i] is 0, then left child is empty!
-        if (memo[i].nA != 0) {
-          newNode = &(nodeObjs[frontier++]);
-          newNode->extent = (*live)[i]->extent;
-          newNode->extent.max[(*live)[i]->splitEdge->axis]
-            = (*live)[i]->splitEdge->t;
-          newNode->cc_triangleIndices = new tbb::concurrent_vector<int>();
-          newNode->triangleCount = memo[i].nA;
-          newLive->push_back(newNode);
-          (*live)[i]->left = newNode;
-        }
-        
-        // if nB of bestEdge for (*live)[i] is 0, then right child is empty!
-        if (memo[i].nB != 0) {
-          newNode = &(nodeObjs[frontier++]);
-          newNode->extent = (*live)[i]->extent;
-          newNode->extent.min[(*live)[i]->splitEdge->axis]
-            = (*live)[i]->splitEdge->t;
-          newNode->cc_triangleIndices = new tbb::concurrent_vector<int>();
-          newNode->triangleCount = memo[i].nB;
-          newLive->push_back(newNode);
-          (*live)[i]->right = newNode;
-        }
-      }
-    }
-
+    newGen(boxEdges, live, memo, newLive);
+    newGenTrace.end();
+    newGenPerf.end();
     RECORD_TIME(
       stats.newGen_usec[level][1],
       stats.newGen[level][1]);
@@ -140,14 +153,17 @@ void KdTreeAccel::parallel_build(v_BoxEdge_inplace &boxEdges, v_Triangle_aux &tr
     RECORD_TIME(
       stats.classifyTriangles_usec[level][0],
       stats.classifyTriangles[level][0]);
-    classifyTriangles(tris, live, memo, base);
+    {
+      PerfScope perf(m_perf, PERF_CLASSIFYTRIANGLES);
+      classifyTriangles(tris, live, memo, base, level);
+    }
 
     RECORD_TIME(
       stats.classifyTriangles_usec[level][1],
       stats.classifyTriangles[level][1]);
 
     // print the split edge
-    if (ver_splitedge) {
+    if (m_options.printSplitEdges) {
       for (uint i=0;i<live->size();i++) {
         if (memo[i].split < boxEdges.size() && 
             memo[i].SAH < numeric_limits<float>::max()) {
@@ -165,8 +181,25 @@ void KdTreeAccel::parallel_build(v_BoxEdge_inplace &boxEdges, v_Triangle_aux &tr
       }
     }
 
+    reportProgress(level, live->size(), boxEdges.size());
+
+    delete [] memo;
+    delete live;
     live = newLive;
     base = (*live)[live->size()-1];
+
+    if (snapshotAt(level+1)) {
+      takeSnapshot(level+1, tris, live);
+    }
+  }
+
+  if (edges != &boxEdges) {
+    delete edges;
+  }
+
+  if (cancelled()) {
+    delete live;
+    return;
   }
 
   // final pass to fill in the tree
@@ -175,125 +208,271 @@ void KdTreeAccel::parallel_build(v_BoxEdge_inplace &boxEdges, v_Triangle_aux &tr
     stats.fill_usec[0],
     stats.fill[0]);
 
-  fill(tris, live);
+  {
+    TraceScope trace(m_tracer, "fill", -1, -1, tris.size());
+    PerfScope perf(m_perf, PERF_FILL);
+    newGen(boxEdges, live, NULL, NULL);
+    fill(tris, live);
+  }
 
   RECORD_TIME(
     stats.fill_usec[1],
     stats.fill[1]);
 
+  reportProgress(level, live->size(), 0);
+  delete live;
+
   m_root = root_;
 
   RECORD_TIME(
     stats.build_finish_usec,
     stats.build_finish);
 
-  // hackery -- move ints from cc_triangleIndices to triangleIndices
-  moveTriangles((KdTreeNode_inplace*)m_root);
   return;
 }
 
 void KdTreeAccel::findBestPlane(v_BoxEdge_inplace &boxEdges, v_Triangle_aux &tris,
-                                vp_KdTreeNode_inplace *live, SplitMemo *memo) {
+                                vp_KdTreeNode_inplace *live, SplitMemo *memo,
+                                uint level) {
   // nAnB prescan
   tbb::task_list tList;
-  // [axis][chunk][live node]
-  PrescanTab pre_tab[3][m_numThreads][live->size()];
-  memset(pre_tab, 0, sizeof(PrescanTab)*3*(m_numThreads)*live->size());
+  // [axis][chunk][live node]; on the heap, as there can be millions of
+  // live nodes deep down
+  uint nodes = live->size();
+  PrescanTab *pre_tab = new PrescanTab[3*m_numThreads*nodes];
+  memset(pre_tab, 0, sizeof(PrescanTab)*3*m_numThreads*nodes);
   uint incr = end_idx[0]/m_numThreads;
 
   for (uint k=0;k<3;k++) {
     uint idx = begin_idx[k];
     for (uint i=0;i<m_numThreads-1;i++) {
       tList.push_back(*new(pRootTask->allocate_child()) 
-                      FindBestPlane_AoS_prescan_task(boxEdges, tris, live, pre_tab[k][i], idx, idx+incr));
+                      FindBestPlane_AoS_prescan_task(boxEdges, tris, live, &pre_tab[(k*m_numThreads+i)*nodes], idx, idx+incr,
+                                                                     m_tracer, level));
       idx += incr;
     }
   }
 
-  if (g_verbose) {
-    pRootTask->set_ref_count(m_numThreads*3+1);
-  } else {
-    pRootTask->set_ref_count((m_numThreads-1)*3+1);
-  }
+  pRootTask->set_ref_count((m_numThreads-1)*3+1);
   pRootTask->spawn_and_wait_for_all(tList);
 
-  // sequential merge -- pass prescan results forward
-  for (uint i=0;i<3;i++) {
-    for (uint j=0;j<m_numThreads-2;j++) {
-      for (uint k=0;k<live->size();k++) {
-        pre_tab[i][j+1][k].nA += pre_tab[i][j][k].nA;
-        pre_tab[i][j+1][k].nB += pre_tab[i][j][k].nB;
-      }
-    }
-  }
+  // pass prescan results forward, each live node on its own
+  RECORD_TIME(
+    stats.prescanMerge_usec[level][0],
+    stats.prescanMerge[level][0]);
+  tbb::parallel_for(tbb::blocked_range<uint>(0, live->size()),
+                    PrescanMerge_task(pre_tab, m_numThreads,
+                                      live->size()));
+  RECORD_TIME(
+    stats.prescanMerge_usec[level][1],
+    stats.prescanMerge[level][1]);
 
-  // nAnB final-scan + SAH
-  SplitMemo memos[3][m_numThreads][live->size()];
-  memset(memos, 0, sizeof(SplitMemo)*3*(m_numThreads)*live->size());
+  // nAnB final-scan + SAH; the last chunk takes the rest of the axis
+  SplitMemo *memos = new SplitMemo[3*m_numThreads*nodes];
+  memset(memos, 0, sizeof(SplitMemo)*3*m_numThreads*nodes);
 
   for (uint k=0;k<3;k++) {
     uint idx = begin_idx[k];
     tList.push_back(*new(pRootTask->allocate_child())
-                    FindBestPlane_AoS_task(boxEdges, tris, live, NULL, memos[k][0], k, idx, idx+incr, this));
+                    FindBestPlane_AoS_task(boxEdges, tris, live, NULL, &memos[k*m_numThreads*nodes], k, idx, idx+incr, this,
+                                                           level));
     idx += incr;
     for (uint i=1;i<m_numThreads;i++) {
       tList.push_back(*new(pRootTask->allocate_child())
-                      FindBestPlane_AoS_task(boxEdges, tris, live, pre_tab[k][i-1], memos[k][i], k, idx, idx+incr, this));
+                      FindBestPlane_AoS_task(boxEdges, tris, live, &pre_tab[(k*m_numThreads+i-1)*nodes], &memos[(k*m_numThreads+i)*nodes], k, idx, (i == m_numThreads-1) ? end_idx[k] : idx+incr, this,
+                                                             level));
       idx += incr;
     }
   }
   pRootTask->set_ref_count(m_numThreads*3+1);
   pRootTask->spawn_and_wait_for_all(tList);
 
-  // sequentially merge memos into memo
-  memcpy(memo, memos[0][0], sizeof(SplitMemo)*live->size());
-  for (uint k=0;k<3;k++) {
-    for (uint t=0;t<m_numThreads;t++) {
-      for (uint l=0;l<live->size();l++) {
-        if (memo[l].SAH > memos[k][t][l].SAH) {
-          memcpy(&memo[l], &memos[k][t][l], sizeof(SplitMemo));
-        }
-      }
-    }
+  // merge memos into memo, each live node on its own
+  RECORD_TIME(
+    stats.memoMerge_usec[level][0],
+    stats.memoMerge[level][0]);
+  bool compacted = boxEdges.size() < proxy.size();
+  tbb::parallel_for(tbb::blocked_range<uint>(0, live->size()),
+                    MemoMerge_task(memos, memo, m_numThreads,
+                                   live->size(),
+                                   compacted ? &boxEdges[0] : NULL,
+                                   &proxy[0]));
+  RECORD_TIME(
+    stats.memoMerge_usec[level][1],
+    stats.memoMerge[level][1]);
+
+  delete [] memos;
+  delete [] pre_tab;
+}
+
+void KdTreeAccel::newGen(v_BoxEdge_inplace &boxEdges,
+                         vp_KdTreeNode_inplace *live, SplitMemo *memo,
+                         vp_KdTreeNode_inplace *newLive) {
+  uint nodes = live->size();
+  if (nodes == 0) return;
+  NewGenSlot *slots = new NewGenSlot[nodes];
+  NewGenScan scan(live, memo, sah, slots);
+  tbb::parallel_scan(tbb::blocked_range<uint>(0, nodes), scan);
+
+  uint nodeBase = m_packedNodes.size();
+  uint itemBase = m_packedItems.size();
+  m_packedNodes.resize(nodeBase + scan.nodes);
+  m_packedItems.resize(itemBase + scan.items);
+  if (newLive) {
+    newLive->resize(scan.children);
+  }
+
+  // children go after the last live node's object, as they always have
+  uint frontier = index((*live)[nodes-1], root_) + 1;
+  tbb::parallel_for(tbb::blocked_range<uint>(0, nodes),
+                    NewGen_task(live, memo, slots,
+                                boxEdges.empty() ? NULL : &boxEdges[0],
+                                &m_packedNodes[0], nodeBase, itemBase,
+                                &(*kdTreeNodeObj)[0] + frontier, newLive));
+  delete [] slots;
+}
+
+void KdTreeAccel::compact(v_BoxEdge_inplace &boxEdges,
+                          v_BoxEdge_inplace *&edges, v_Triangle_aux &tris) {
+  uint n = tris.size();
+  uint *newIdx = new uint[n];
+  CompactTrisScan trisScan(tris, newIdx);
+  tbb::parallel_scan(tbb::blocked_range<uint>(0, n), trisScan);
+
+  // not worth a pass over the edges for less than an eighth of them
+  uint m = trisScan.count;
+  if (m == 0 || n - m < n/8) {
+    delete [] newIdx;
+    return;
+  }
+
+  uint *srcIdx = new uint[6*m];
+  CompactEdgesScan edgesScan(*edges, srcIdx);
+  tbb::parallel_scan(tbb::blocked_range<uint>(0, edges->size()), edgesScan);
+
+  v_Triangle_aux &compactedTris = *new v_Triangle_aux(
+    m, Triangle_aux(), OutOfCoreAllocator<Triangle_aux>(outOfCoreDir()));
+  numaPlace(compactedTris, m_options.numaPolicy, m_numThreads);
+
+  v_BoxEdge_inplace *compacted = new v_BoxEdge_inplace(
+    6*m, BoxEdge_inplace(), OutOfCoreAllocator<BoxEdge_inplace>(outOfCoreDir()));
+  numaPlace(*compacted, m_options.numaPolicy, 3*m_numThreads);
+
+  tbb::parallel_for(tbb::blocked_range<uint>(0, 6*m),
+                    CompactEdges_task(*edges, *compacted, srcIdx, &tris[0],
+                                      &compactedTris[0], newIdx));
+  tbb::parallel_for(tbb::blocked_range<uint>(0, n),
+                    CompactTris_task(tris, compactedTris, newIdx));
+
+  // the proxy edges stay where they are, for the nodes' splitEdge/s
+  if (edges != &boxEdges) {
+    delete edges;
+  }
+  edges = compacted;
+  tris.swap(compactedTris);
+  delete &compactedTris;
+  delete [] srcIdx;
+  delete [] newIdx;
+
+  // x, y, z
+  for (uint i=0;i<3;i++) {
+    begin_idx[i] = 2*m*i;
+    end_idx[i] = 2*m*(i+1);
   }
 }
 
 void KdTreeAccel::classifyTriangles(v_Triangle_aux &tris, vp_KdTreeNode_inplace *live, 
-                                    SplitMemo *memo, KdTreeNode_inplace *base) {
+                                    SplitMemo *memo, KdTreeNode_inplace *base,
+                                    uint level) {
   tbb::task_list tList;
   uint incr = tris.size()/m_numThreads;
   uint idx = 0;
-  uint stat[m_numThreads-1][live->size()][3]; // left, straddle, right
   uint task_id = 0;
+
+  // nodes that stay leaves write straight into their item ranges, through
+  // shared cursors or, in deterministic mode, per-chunk offsets that keep
+  // them in triangle order whatever the thread count or timing
+  bool leaves = false;
+  for (uint l=0;l<live->size();l++) {
+    leaves = leaves || !(*live)[l]->splitEdge;
+  }
+  tbb::atomic<uint> *leafCursors = NULL; // [live node]
+  uint *leafOffsets = NULL;              // [chunk][live node]
+  if (leaves && m_options.deterministic) {
+    leafOffsets = leafOffsetsFor(tris, live);
+  } else if (leaves) {
+    leafCursors = new tbb::atomic<uint>[live->size()];
+    for (uint l=0;l<live->size();l++) {
+      leafCursors[l] = (*live)[l]->itemOffset;
+    }
+  }
+  int *items = m_packedItems.empty() ? NULL : &m_packedItems[0];
+
   for (uint t=0;t<m_numThreads-1;t++) {
-    tList.push_back(*new(pRootTask->allocate_child()) Split_task(tris, live, base, idx, idx+incr, task_id++));
+    tList.push_back(*new(pRootTask->allocate_child()) Split_task(tris, live, base, idx, idx+incr, task_id++,
+                                                                  m_tracer, level, items, leafCursors,
+                                                                  leafOffsets ? &leafOffsets[t*live->size()] : NULL));
     idx += incr;
   }
-  tList.push_back(*new(pRootTask->allocate_child()) Split_task(tris, live, base, idx, tris.size(), task_id++));
+  tList.push_back(*new(pRootTask->allocate_child()) Split_task(tris, live, base, idx, tris.size(), task_id++,
+                                                                m_tracer, level, items, leafCursors,
+                                                                leafOffsets ? &leafOffsets[(m_numThreads-1)*live->size()] : NULL));
 
   pRootTask->set_ref_count(m_numThreads+1);
   pRootTask->spawn_and_wait_for_all(tList);
+
+  delete [] leafCursors;
+  delete [] leafOffsets;
 }
 
-void KdTreeAccel::fill(v_Triangle_aux &tris, vp_KdTreeNode_inplace *live) {
-    for (v_Triangle_aux::iterator I=tris.begin(), E=tris.end();
-       I!=E; I++) {
-    Triangle_aux &tri = *I;
-    for (uint j=0;j<tri.membership_size;j++) {
-      unsigned char l=tri.membership[j];
-      (*live)[l]->cc_triangleIndices->push_back(tri.triangleIndex);
+uint *KdTreeAccel::leafOffsetsFor(const v_Triangle_aux &tris,
+                                  vp_KdTreeNode_inplace *live) {
+  uint nodes = live->size();
+
+  // count per chunk, in the chunks classifyTriangles uses
+  uint *offsets = new uint[m_numThreads*nodes];
+  memset(offsets, 0, sizeof(uint)*m_numThreads*nodes);
+  tbb::task_list tList;
+  uint incr = tris.size()/m_numThreads;
+  for (uint t=0;t<m_numThreads;t++) {
+    uint end = (t == m_numThreads-1) ? tris.size() : (t+1)*incr;
+    tList.push_back(*new(pRootTask->allocate_child())
+                    LeafCount_task(tris, live, t*incr, end, &offsets[t*nodes]));
+  }
+  pRootTask->set_ref_count(m_numThreads+1);
+  pRootTask->spawn_and_wait_for_all(tList);
+
+  // exclusive prefix sum over the chunks of each node, from the start of
+  // its item range
+  for (uint l=0;l<nodes;l++) {
+    KdTreeNode_inplace *A = (*live)[l];
+    if (A->splitEdge) continue;
+
+    uint total = A->itemOffset;
+    for (uint t=0;t<m_numThreads;t++) {
+      uint cnt = offsets[t*nodes+l];
+      offsets[t*nodes+l] = total;
+      total += cnt;
     }
   }
+  return offsets;
 }
 
-void KdTreeAccel::moveTriangles(KdTreeNode_inplace *node) {
-  if (!node->triangleIndices) {
-    node->triangleIndices = new vector<int>();
-  }
-  if (node->cc_triangleIndices && node->cc_triangleIndices->size()) {
-    copy(node->cc_triangleIndices->begin(), node->cc_triangleIndices->end(),
-         insert_iterator<vector<int> >(*node->triangleIndices, node->triangleIndices->begin()));
+void KdTreeAccel::fill(v_Triangle_aux &tris, vp_KdTreeNode_inplace *live) {
+  // count each chunk's share of every leaf, then scatter at those offsets
+  uint nodes = live->size();
+  uint *offsets = leafOffsetsFor(tris, live);
+  int *items = m_packedItems.empty() ? NULL : &m_packedItems[0];
+
+  tbb::task_list tList;
+  uint incr = tris.size()/m_numThreads;
+  for (uint t=0;t<m_numThreads;t++) {
+    uint end = (t == m_numThreads-1) ? tris.size() : (t+1)*incr;
+    tList.push_back(*new(pRootTask->allocate_child())
+                    Fill_task(tris, t*incr, end, &offsets[t*nodes], items));
   }
-  if (node->left) moveTriangles((KdTreeNode_inplace*)node->left);
-  if (node->right) moveTriangles((KdTreeNode_inplace*)node->right);
+  pRootTask->set_ref_count(m_numThreads+1);
+  pRootTask->spawn_and_wait_for_all(tList);
+
+  delete [] offsets;
 }
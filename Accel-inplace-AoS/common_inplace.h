@@ -44,6 +44,7 @@
 
 #include <tbb/scalable_allocator.h>
 
+#include "OutOfCore.h"
 #include "KdTreeNode_inplace.h"
 #include "Triangle_aux.h"
 
@@ -52,8 +53,10 @@ typedef unsigned int uint;
 typedef std::vector<KdTreeNode_inplace, tbb::cache_aligned_allocator<KdTreeNode_inplace> > v_KdTreeNode_inplace;
 typedef std::vector<KdTreeNode_inplace*, tbb::scalable_allocator<KdTreeNode_inplace*> > vp_KdTreeNode_inplace;
 typedef std::vector<vp_KdTreeNode_inplace, tbb::scalable_allocator<vp_KdTreeNode_inplace> > vvp_KdTreeNode_inplace;
-typedef std::vector<Triangle_aux, tbb::cache_aligned_allocator<Triangle_aux> > v_Triangle_aux;
-typedef std::vector<BoxEdge_inplace, tbb::cache_aligned_allocator<BoxEdge_inplace> > v_BoxEdge_inplace;
+// swept every level and reached through the edges; in files with --out-of-core
+typedef std::vector<Triangle_aux, OutOfCoreAllocator<Triangle_aux> > v_Triangle_aux;
+// swept every level; in files with --out-of-core
+typedef std::vector<BoxEdge_inplace, OutOfCoreAllocator<BoxEdge_inplace> > v_BoxEdge_inplace;
 typedef std::vector<BoxEdge_inplace*, tbb::cache_aligned_allocator<BoxEdge_inplace*> > vp_BoxEdge_inplace;
 
 // this is how you sort boxEdge/s
@@ -0,0 +1,176 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _COMPACT_TASK_H_
+#define _COMPACT_TASK_H_
+
+#include <algorithm>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_scan.h>
+
+#include "TAB.h"
+
+// --compact: parallel_scan/parallel_for bodies that drop the triangles
+// that are only in leaves by now (membership_size 0) from the arrays the
+// level sweeps visit. Both keep the order, so the edges stay sorted and
+// the triangles in Xs order. The sorted proxy edges themselves never
+// move: Triangle_aux::edges and the nodes' splitEdge/s keep pointing at
+// them.
+
+// a finished triangle: no live node holds it any more
+inline bool finished(const Triangle_aux &tri) {
+  return tri.membership_size == 0;
+}
+
+// exclusive prefix count of the unfinished triangles: their new places
+class CompactTrisScan {
+public:
+  CompactTrisScan(const v_Triangle_aux &tris, uint *newIdx)
+    : count(0), tris(tris), newIdx(newIdx) {}
+  CompactTrisScan(CompactTrisScan &other, tbb::split)
+    : count(0), tris(other.tris), newIdx(other.newIdx) {}
+
+  template<typename Tag>
+  void operator()(const tbb::blocked_range<uint> &range, Tag) {
+    for (uint i=range.begin();i!=range.end();i++) {
+      if (finished(tris[i])) continue;
+      if (Tag::is_final_scan()) newIdx[i] = count;
+      count++;
+    }
+  }
+  void reverse_join(CompactTrisScan &left) { count += left.count; }
+  void assign(CompactTrisScan &other) { count = other.count; }
+
+  uint count; // unfinished triangles, after the scan
+
+private:
+  const v_Triangle_aux &tris;
+  uint *newIdx;
+};
+
+// the same over the table's edges; every triangle has two on each axis,
+// so the axes stay the same length. Records where each kept edge was.
+class CompactEdgesScan {
+public:
+  CompactEdgesScan(const TAB &table, uint *srcIdx)
+    : count(0), table(table), srcIdx(srcIdx) {}
+  CompactEdgesScan(CompactEdgesScan &other, tbb::split)
+    : count(0), table(other.table), srcIdx(other.srcIdx) {}
+
+  template<typename Tag>
+  void operator()(const tbb::blocked_range<uint> &range, Tag) {
+    for (uint i=range.begin();i!=range.end();i++) {
+      if (finished(*table.tri_tab[i])) continue;
+      if (Tag::is_final_scan()) srcIdx[count] = i;
+      count++;
+    }
+  }
+  void reverse_join(CompactEdgesScan &left) { count += left.count; }
+  void assign(CompactEdgesScan &other) { count = other.count; }
+
+  uint count;
+
+private:
+  const TAB &table;
+  uint *srcIdx;
+};
+
+// gathers the kept edges into the new columns, in blocks of
+// COMPACT_BLOCK, which keeps threads off each other's edgeType_tab words
+#define COMPACT_BLOCK 4096
+
+class CompactTable_task {
+public:
+  CompactTable_task(const TAB &table, TAB &compacted, const uint *srcIdx,
+                    const Triangle_aux *oldTris, Triangle_aux *newTris,
+                    const uint *newIdx)
+    : table(table), compacted(compacted), srcIdx(srcIdx), oldTris(oldTris),
+      newTris(newTris), newIdx(newIdx) {}
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    uint size = compacted.t_tab.size();
+    for (uint b=range.begin();b!=range.end();b++) {
+      uint end = std::min(size, (b+1)*COMPACT_BLOCK);
+      for (uint j=b*COMPACT_BLOCK;j<end;j++) {
+        uint i = srcIdx[j];
+        compacted.t_tab[j] = table.t_tab[i];
+        compacted.edgeType_tab[j] = table.edgeType_tab[i];
+        compacted.tri_tab[j] = &newTris[newIdx[table.tri_tab[i] - oldTris]];
+      }
+    }
+  }
+
+private:
+  const TAB &table;
+  TAB &compacted;
+  const uint *srcIdx;
+  const Triangle_aux *oldTris;
+  Triangle_aux *newTris;
+  const uint *newIdx;
+};
+
+// moves the unfinished triangles and points their proxy edges at the new
+// places; the finished ones' proxy edges lose theirs
+class CompactTris_task {
+public:
+  CompactTris_task(v_Triangle_aux &tris, v_Triangle_aux &compacted,
+                   const uint *newIdx)
+    : tris(tris), compacted(compacted), newIdx(newIdx) {}
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    for (uint i=range.begin();i!=range.end();i++) {
+      Triangle_aux *tri = NULL;
+      if (!finished(tris[i])) {
+        tri = &compacted[newIdx[i]];
+        *tri = tris[i];
+      }
+      for (uint e=0;e<6;e++) {
+        tris[i].edges[e]->tri = tri;
+      }
+    }
+  }
+
+private:
+  v_Triangle_aux &tris;
+  v_Triangle_aux &compacted;
+  const uint *newIdx;
+};
+
+#endif // _COMPACT_TASK_H_
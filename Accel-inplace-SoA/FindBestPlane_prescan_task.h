@@ -42,19 +42,22 @@
 
 #include "common_inplace.h"
 #include "PrescanTab.h"
+#include "Tracer.h"
 
 class FindBestPlane_prescan_task : public tbb::task {
 public:
   FindBestPlane_prescan_task(TAB &table, v_Triangle_aux &tris,
                              vp_KdTreeNode_inplace *live, PrescanTab *tab,
-                             uint begin, uint end) : 
-    table(table), tris(tris), live(live), tab(tab), begin(begin), end(end) {};
+                             uint begin, uint end, Tracer *tracer, uint level) : 
+    table(table), tris(tris), live(live), tab(tab), begin(begin), end(end), tracer(tracer), level(level) {};
 
   tbb::task *execute() {
+    TraceScope trace(tracer, "prescan", level, -1, end-begin);
+
     // doing this in reverse might improve temporal locality
     for (uint i=begin;i<end;i++) {
       for (uint j=0;j<table.tri_tab[i]->membership_size;j++) {
-        unsigned char l=table.tri_tab[i]->membership[j];
+        uint l=table.tri_tab[i]->membership[j];
         if (table.edgeType_tab[i] == END) {
           tab[l].nB++;
         }
@@ -73,6 +76,8 @@ private:
   const v_Triangle_aux &tris;
   const vp_KdTreeNode_inplace *const live;
   PrescanTab *tab;
+  Tracer *tracer;
+  const uint level;
 };
 
 #endif // _FINDBESTPLANE_PRESCAN_TASK_H_
@@ -45,18 +45,22 @@
 #include <tbb/task.h>
 
 #include "PrescanTab.h"
+#include "Tracer.h"
 
 class FindBestPlane_task : public tbb::task {
 public:
   FindBestPlane_task(const TAB &table, const v_Triangle_aux &tris,
                      const vp_KdTreeNode_inplace *live, PrescanTab *tab, SplitMemo *memo,
-                     uint axis, uint begin, uint end, KdTreeAccel *accel) :
+                     uint axis, uint begin, uint end, KdTreeAccel *accel,
+                     uint level) :
     table(table), tris(tris), live(live), tab(tab), memo(memo), axis(axis),
-    begin(begin), end(end), accel(accel) {};
+    begin(begin), end(end), accel(accel), level(level) {};
 
   ~FindBestPlane_task() {};
 
   tbb::task *execute() {
+    TraceScope trace(accel->tracer(), "final scan", level, -1, end-begin);
+
     if (!tab) { // this means this is the first chunk -- no prescan needed
       tab = (PrescanTab*)scalable_calloc(live->size(), sizeof(PrescanTab));
     }
@@ -67,7 +71,7 @@ public:
     
     for (uint i=begin;i<end;i++) {
       for (uint j=0;j<table.tri_tab[i]->membership_size;j++) {
-        unsigned char l = table.tri_tab[i]->membership[j];
+        uint l = table.tri_tab[i]->membership[j];
         if (table.edgeType_tab[i] == END) {
           tab[l].nB++;
         }
@@ -98,6 +102,7 @@ private:
   PrescanTab *tab;
   SplitMemo *memo;
   const KdTreeAccel *accel;
+  const uint level;
 };
 
 #endif // _FINDBESTPLANE_TASK_H_
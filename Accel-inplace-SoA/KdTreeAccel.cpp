@@ -39,10 +39,11 @@
 
 #include <iomanip>
 #include <stdio.h>
+#include <string.h>
 
-#include <tbb/task_scheduler_init.h>
 #include <tbb/partitioner.h>
 #include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
 
 #include "KdTreeAccel.h"
 #include "CreateEdges_task.h"
@@ -53,7 +54,7 @@
 #include "Split_task.h"
 #include "parallel_mergesort.h"
 #include "timers.h"
-#include "options.h"
+#include "PerfCounters.h"
 
 using namespace std;
 using namespace tbb;
@@ -71,11 +72,33 @@ void impl_usage() {
   }
 }
 
-bool ver_splitedge;
+KdTreeAccel::KdTreeAccel(const GeometryView &geometry,
+                         const BuildOptions &options)
+  : KdTreeAccel_base(geometry, options), kdTreeNodeObj(NULL),
+    proxy(OutOfCoreAllocator<BoxEdge_inplace>(outOfCoreDir())),
+    stats(options.maxDepth) { }
 
-KdTreeAccel::KdTreeAccel(TriangleMesh *mesh, 
-                         uint numThreads, uint maxDepth)
-  : KdTreeAccel_base(mesh, numThreads, maxDepth), stats(maxDepth) { }
+KdTreeAccel::~KdTreeAccel() {
+  releaseNodes();
+}
+
+void KdTreeAccel::releaseNodes() {
+  if (!kdTreeNodeObj) return;
+
+  // nodes are bump-allocated (custom_mm), so their index lists are ours
+  for (v_KdTreeNode_inplace::iterator I=kdTreeNodeObj->begin(),
+         E=kdTreeNodeObj->end(); I!=E; I++) {
+    delete I->triangleIndices;
+  }
+  delete kdTreeNodeObj;
+  kdTreeNodeObj = NULL;
+}
+
+void KdTreeAccel::discard() {
+  releaseNodes();
+  v_BoxEdge_inplace(proxy.get_allocator()).swap(proxy);
+  discardTree();
+}
 
 string KdTreeAccel::impl_string() {
   return string("In-place (SoA) version");
@@ -85,10 +108,10 @@ void KdTreeAccel::build() {
   RECORD_TIME(
     stats.start_usec,
     stats.start);
+  beginBuild();
+  PerfScope createEdgesPerf(m_perf, PERF_CREATEEDGES);
 
-  // init task scheduler
-  task_scheduler_init init(m_numThreads);
-  uint n = m_mesh->triangleList.size(); // number of triangles
+  uint n = m_geometry.numTriangles(); // number of triangles
   // x, y, z edges concatenated
   xbegin_idx = 0;
   xend_idx = xbegin_idx + 2*n;
@@ -96,47 +119,74 @@ void KdTreeAccel::build() {
   yend_idx = ybegin_idx + 2*n;
   zbegin_idx = yend_idx;
   zend_idx = zbegin_idx + 2*n;
-  v_Triangle_aux &tris = *new v_Triangle_aux(n);
+  v_Triangle_aux &tris = *new v_Triangle_aux(
+    n, Triangle_aux(), OutOfCoreAllocator<Triangle_aux>(outOfCoreDir()));
+  // the arrays are chunked like the phases that stream through them: per
+  // axis for edges (FindBestPlane), whole for triangles (Split)
+  numaPlace(tris, m_options.numaPolicy, m_numThreads);
 
   // build consecutive array of kdTreeNode/s -- assume full-tree
+  releaseNodes(); // a previous build's
   kdTreeNodeObj = new v_KdTreeNode_inplace(1<<(m_maxDepth+1));
   // root_ is the first one
   root_ = &((*kdTreeNodeObj)[0]);
 
   // all triangles
-  root_->triangleCount = m_mesh->triangleList.size();
-  root_->extent = m_mesh->boundingBox;
-  root_->triangleIndices = new vector<int>();
+  root_->triangleCount = n;
+
+  // the packed tree starts out as the root; every triangle lands in at
+  // least one leaf
+  m_packedNodes.assign(1, MantaKDTreeNode());
+  m_packedItems.clear();
+  m_packedItems.reserve(n);
+  m_leavesUnpacked = false;
+  root_->packedIdx = 0;
+  m_snapshots.clear();
 
   proxy.resize(6*n); // sort proxy.. sort this to find out right index
                             // for boxEdge/s (unpacked) -- index into tab/s
-
-  parallel_for(blocked_range<size_t>(xbegin_idx, xbegin_idx+n),
-               CreateEdges_task(proxy, tris, root_, m_mesh->triangleList, 0, 0),
-               auto_partitioner());
-  parallel_for(blocked_range<size_t>(ybegin_idx, ybegin_idx+n),
-               CreateEdges_task(proxy, tris, root_, m_mesh->triangleList, 1, 2*n),
-               auto_partitioner());
-  parallel_for(blocked_range<size_t>(zbegin_idx, zbegin_idx+n),
-               CreateEdges_task(proxy, tris, root_, m_mesh->triangleList, 2, 4*n),
-               auto_partitioner());
-
+  numaPlace(proxy, m_options.numaPolicy, 3*m_numThreads);
+
+  // triangle bounds come straight from the caller's buffers; the root
+  // extent falls out of the same pass
+  CreateEdges_task xedges(proxy, tris, root_, m_geometry, 0, 0);
+  CreateEdges_task yedges(proxy, tris, root_, m_geometry, 1, 2*n);
+  CreateEdges_task zedges(proxy, tris, root_, m_geometry, 2, 4*n);
+  parallel_reduce(blocked_range<size_t>(xbegin_idx, xbegin_idx+n),
+                  xedges, auto_partitioner());
+  parallel_reduce(blocked_range<size_t>(ybegin_idx, ybegin_idx+n),
+                  yedges, auto_partitioner());
+  parallel_reduce(blocked_range<size_t>(zbegin_idx, zbegin_idx+n),
+                  zedges, auto_partitioner());
+  root_->extent = BoundingBox(xedges.lo, xedges.hi, yedges.lo, yedges.hi,
+                              zedges.lo, zedges.hi);
+
+  createEdgesPerf.end();
   RECORD_TIME(
     stats.init_CreateEdges_usec,
     stats.init_CreateEdges);
+  if (checkCancel()) {
+    delete &tris;
+    discard();
+    return;
+  }
+  PerfScope sortPerf(m_perf, PERF_SORT);
 
   // sort + tri setup on x,y, and z
-  v_BoxEdge_inplace scratch(2*n);
+  v_BoxEdge_inplace scratch(2*n, BoxEdge_inplace(), proxy.get_allocator());
+  numaPlace(scratch, m_options.numaPolicy, m_numThreads);
   parallel_mergesort(proxy.begin(), proxy.begin()+2*n,
-                     scratch.begin(), scratch.end());
+                     scratch.begin(), scratch.end(), m_tracer);
   parallel_mergesort(proxy.begin()+4*n, proxy.begin()+6*n,
-                     scratch.begin(), scratch.end());
+                     scratch.begin(), scratch.end(), m_tracer);
   parallel_mergesort(proxy.begin()+2*n, proxy.begin()+4*n,
-                     scratch.begin(), scratch.end());
+                     scratch.begin(), scratch.end(), m_tracer);
 
+  sortPerf.end();
   RECORD_TIME(
     stats.init_sort_usec,
     stats.init_sort);
+  PerfScope setupPerf(m_perf, PERF_SETUPTRIANGLES);
 
   parallel_for(blocked_range<size_t>(xbegin_idx, xend_idx),
                SetupTriangles_task(proxy), auto_partitioner());
@@ -145,18 +195,28 @@ void KdTreeAccel::build() {
   parallel_for(blocked_range<size_t>(zbegin_idx, zend_idx),
                SetupTriangles_task(proxy), auto_partitioner());
 
+  setupPerf.end();
   RECORD_TIME(
     stats.init_SetupTriangles_usec,
     stats.init_SetupTriangles);
+  if (checkCancel()) {
+    delete &tris;
+    discard();
+    return;
+  }
+  PerfScope unpackPerf(m_perf, PERF_UNPACK);
 
   // unpack objects into array format
   // indexing into these arrays would give you the corresponding field value
   // better spatial-locality for streaming
   TAB *table;
-  table = new TAB(); // let's just let this leak for the moment
+  table = new TAB(outOfCoreDir());
   table->t_tab.resize(proxy.size());
   table->edgeType_tab.resize(proxy.size());
   table->tri_tab.resize(proxy.size());
+  // (edgeType_tab is bit-packed and small enough to leave alone)
+  numaPlace(table->t_tab, m_options.numaPolicy, 3*m_numThreads);
+  numaPlace(table->tri_tab, m_options.numaPolicy, 3*m_numThreads);
 
   for(uint i=0;i<proxy.size();i++) {
     table->t_tab[i] = proxy[i].t;
@@ -165,25 +225,112 @@ void KdTreeAccel::build() {
   }
 
   //stats.init_unpack = stats.init_finish = rdtsc();
+  unpackPerf.end();
   RECORD_TIME(
     stats.init_finish_usec,
     stats.init_finish);
-  if (g_time_in_ticks) {
-    stats.init_unpack = stats.init_finish;
-  } else {
-    stats.init_unpack_usec = stats.init_finish_usec;
-  }
+  stats.init_unpack = stats.init_finish;
+  stats.init_unpack_usec = stats.init_finish_usec;
 
   if (m_numThreads > 1) {
     pRootTask = new(task::allocate_root()) empty_task;
     parallel_build(proxy, *table, tris, m_maxDepth); // w/ unpacked objects
+    pRootTask->destroy(*pRootTask);
   } else {
     sequential_build(proxy, *table, tris, m_maxDepth);
   }
+
+  // only proxy (the nodes' splitEdge/s point into it) outlives the build
+  delete table;
+  delete &tris;
+
+  if (cancelled()) {
+    discard();
+  }
+}
+
+uint KdTreeAccel::packSplit(KdTreeNode_inplace *node) {
+  uint childIdx = m_packedNodes.size();
+  MantaKDTreeNode empty = MantaKDTreeNode();
+  empty.isLeaf = true;
+  empty.numPrimitives = 0;
+  empty.childIdx = m_packedItems.size();
+  m_packedNodes.push_back(empty); // left
+  m_packedNodes.push_back(empty); // right
+
+  MantaKDTreeNode &packedNode = m_packedNodes[node->packedIdx];
+  packedNode.isLeaf = false;
+  packedNode.planePos = node->splitEdge->t;
+  packedNode.planeDim = node->splitEdge->axis;
+  packedNode.childIdx = childIdx;
+  return childIdx;
+}
+
+void KdTreeAccel::packLeaf(KdTreeNode_inplace *node) {
+  node->itemOffset = m_packedItems.size();
+  m_packedItems.resize(node->itemOffset + node->triangleCount);
+
+  MantaKDTreeNode &packedNode = m_packedNodes[node->packedIdx];
+  packedNode.isLeaf = true;
+  packedNode.numPrimitives = node->triangleCount;
+  packedNode.childIdx = node->itemOffset;
+}
+
+void KdTreeAccel::takeSnapshot(uint depth, const v_Triangle_aux &tris,
+                               const vp_KdTreeNode_inplace *live) {
+  m_snapshots.push_back(TreeSnapshot());
+  TreeSnapshot &snapshot = m_snapshots.back();
+  snapshot.depth = depth;
+  snapshot.nodes = m_packedNodes;
+  snapshot.items = m_packedItems;
+
+  // what packLeaf() and fill() will do to the live nodes at maxDepth
+  uint *cursor = new uint[live->size()];
+  for (uint l=0;l<live->size();l++) {
+    const KdTreeNode_inplace *node = (*live)[l];
+    MantaKDTreeNode &packedNode = snapshot.nodes[node->packedIdx];
+    packedNode.isLeaf = true;
+    packedNode.numPrimitives = node->triangleCount;
+    packedNode.childIdx = cursor[l] = snapshot.items.size();
+    snapshot.items.resize(snapshot.items.size() + node->triangleCount);
+  }
+  for (uint i=0;i<tris.size();i++) {
+    const Triangle_aux &tri = tris[i];
+    for (uint j=0;j<tri.membership_size;j++) {
+      snapshot.items[cursor[tri.membership[j]]++] = tri.triangleIndex;
+    }
+  }
+  delete [] cursor;
+
+  snapshot.quality.compute(snapshot.nodes, root_->extent, sah,
+                           m_geometry.numTriangles());
+}
+
+// --segmented: a line per level with its sweep and regroup times (ticks
+// or microseconds) and, where the flat sweep was timed too, its speedup
+template <class T>
+static void printSweepTimes(ostream &out, uint maxDepth, const T sweep[][2],
+                            const T regroup[][2], const T flat[][2]) {
+  char level[32], times[64];
+  out << setw(34) << left << "Sweep / regroup time per level" << ":\n";
+  for (uint i=0;i<maxDepth;i++) {
+    unsigned long sweepTime = sweep[i][1] - sweep[i][0];
+    unsigned long flatTime = flat[i][1] - flat[i][0];
+    sprintf(level, "  Level %u", i);
+    sprintf(times, "%lu / %lu", sweepTime,
+            (unsigned long)(regroup[i][1] - regroup[i][0]));
+    out << setw(34) << left << level << ": "
+        << setw(20) << right << times;
+    if (flatTime && sweepTime) {
+      sprintf(times, "  (%.2fx flat)", (double)flatTime / sweepTime);
+      out << times;
+    }
+    out << "\n";
+  }
 }
 
 void KdTreeAccel::printTimingStats(ostream &out) {
-  if (g_time_in_ticks) {
+  if (m_options.timeInTicks) {
     out << "     In-place (SoA) TIMING INFORMATION (in CPU ticks)\n\n";
   
     char buf[128];
@@ -228,6 +375,20 @@ void KdTreeAccel::printTimingStats(ostream &out) {
     out << setw(34) << left << "FindBestPlane time (Avg)" << ": "
         << setw(20) << right << total/m_maxDepth << "\n";
   
+    total = 0L;
+    for (uint i=0;i<m_maxDepth;i++) {
+      total += stats.prescanMerge[i][1] - stats.prescanMerge[i][0];
+    }
+    out << setw(34) << left << "  Prescan merge time (Avg)" << ": "
+        << setw(20) << right << total/m_maxDepth << "\n";
+  
+    total = 0L;
+    for (uint i=0;i<m_maxDepth;i++) {
+      total += stats.memoMerge[i][1] - stats.memoMerge[i][0];
+    }
+    out << setw(34) << left << "  Memo merge time (Avg)" << ": "
+        << setw(20) << right << total/m_maxDepth << "\n";
+  
     total = 0L;
     for (uint i=0;i<m_maxDepth;i++) {
       total += stats.newGen[i][1] - stats.newGen[i][0];
@@ -242,6 +403,22 @@ void KdTreeAccel::printTimingStats(ostream &out) {
     out << setw(34) << left << "ClassifyTriangles time (Avg)" << ": " 
         << setw(20) << right << total/m_maxDepth << "\n";
   
+    if (m_options.compactEvery) {
+      total = 0L;
+      for (uint i=0;i<m_maxDepth;i++) {
+        total += stats.compact[i][1] - stats.compact[i][0];
+      }
+      out << setw(34) << left << "Compaction time (Total)" << ": "
+          << setw(20) << right << total << "\n";
+    }
+  
+    // --segmented: each level's sweep next to what laying out its runs
+    // took, and with -v the flat sweep's time over the sweep's
+    if (m_options.segmented) {
+      printSweepTimes(out, m_maxDepth, stats.findBestPlane, stats.regroup,
+                      stats.flatSweep);
+    }
+  
     out << setw(34) << left << "Fill time" << ": " 
         << setw(20) << right << stats.fill[1] - stats.fill[0] << "\n";
   
@@ -291,6 +468,20 @@ void KdTreeAccel::printTimingStats(ostream &out) {
     out << setw(34) << left << "FindBestPlane time (Avg)" << ": "
         << setw(20) << right << total/m_maxDepth << "\n";
   
+    total = 0L;
+    for (uint i=0;i<m_maxDepth;i++) {
+      total += stats.prescanMerge_usec[i][1] - stats.prescanMerge_usec[i][0];
+    }
+    out << setw(34) << left << "  Prescan merge time (Avg)" << ": "
+        << setw(20) << right << total/m_maxDepth << "\n";
+  
+    total = 0L;
+    for (uint i=0;i<m_maxDepth;i++) {
+      total += stats.memoMerge_usec[i][1] - stats.memoMerge_usec[i][0];
+    }
+    out << setw(34) << left << "  Memo merge time (Avg)" << ": "
+        << setw(20) << right << total/m_maxDepth << "\n";
+  
     total = 0L;
     for (uint i=0;i<m_maxDepth;i++) {
       total += stats.newGen_usec[i][1] - stats.newGen_usec[i][0];
@@ -306,6 +497,20 @@ void KdTreeAccel::printTimingStats(ostream &out) {
     out << setw(34) << left << "ClassifyTriangles time (Avg)" << ": " 
         << setw(20) << right << total/m_maxDepth << "\n";
   
+    if (m_options.compactEvery) {
+      total = 0L;
+      for (uint i=0;i<m_maxDepth;i++) {
+        total += stats.compact_usec[i][1] - stats.compact_usec[i][0];
+      }
+      out << setw(34) << left << "Compaction time (Total)" << ": "
+          << setw(20) << right << total << "\n";
+    }
+  
+    if (m_options.segmented) {
+      printSweepTimes(out, m_maxDepth, stats.findBestPlane_usec,
+                      stats.regroup_usec, stats.flatSweep_usec);
+    }
+  
     out << setw(34) << left << "Fill time" << ": " 
         << setw(20) << right << stats.fill_usec[1] - stats.fill_usec[0] << "\n";
   
@@ -322,10 +527,8 @@ void KdTreeAccel::printTimingStats(ostream &out) {
 
 void KdTreeAccel::printTimingStatsCSVHeader(std::ostream &out) {
   stats.printCSVHeader(out);
-  cerr << "\n";
 }
 
 void KdTreeAccel::printTimingStatsCSV(std::ostream &out) {
-  stats.printCSV(out);
-  cerr << "\n";
+  stats.printCSV(out, m_options.timeInTicks);
 }
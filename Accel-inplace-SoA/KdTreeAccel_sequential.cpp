@@ -40,10 +40,12 @@
 #include <iostream>
 #include <iomanip>
 #include <limits>
+#include <string.h>
 
-#include "options.h"
 #include "KdTreeAccel.h"
 #include "timers.h"
+#include "Tracer.h"
+#include "PerfCounters.h"
 
 using namespace std;
 
@@ -58,7 +60,7 @@ void KdTreeAccel::sequential_build(v_BoxEdge_inplace &boxEdges, TAB &table,
     tris[i].membership[0] = 0;
   }
 
-  uint n = m_mesh->triangleList.size();
+  uint n = m_geometry.numTriangles();
 
   // x, y, z
   int begin_idx[3] = { 0, 2*n, 4*n };
@@ -70,23 +72,40 @@ void KdTreeAccel::sequential_build(v_BoxEdge_inplace &boxEdges, TAB &table,
 
   KdTreeNode_inplace *base = root_;
 
+  // --budget-ms: levels take about as long as the one before; stop when
+  // the time is spent, or before a level that won't fit in what is left
+  double levelStartMs = 0, levelMs = 0;
+
   // each iteration builds a level
-  for (uint level=0; level<maxDepth; level++) {
+  uint level;
+  for (level=0; level<maxDepth; level++) {
+
+    if (m_options.budgetMs) {
+      double left = budgetLeftMs();
+      levelMs = levelStartMs - left;
+      levelStartMs = left;
+      if (left <= 0 || (level > 0 && left < levelMs)) break;
+    }
+    if (checkCancel()) {
+      break;
+    }
 
     // FindBestPlane
     RECORD_TIME(
       stats.findBestPlane_usec[level][0],
       stats.findBestPlane[level][0]);
+    TraceScope findBestPlaneTrace(m_tracer, "find best plane", level, -1, boxEdges.size());
+    PerfScope findBestPlanePerf(m_perf, PERF_FINDBESTPLANE);
 
-    SplitMemo memo[live->size()];
-    uint running[live->size()][2]; // 0 : nA, 1 : nB
+    SplitMemo *memo = new SplitMemo[live->size()];
+    uint (*running)[2] = new uint[live->size()][2]; // 0 : nA, 1 : nB
     
     // superfluous pre-scan -- for comparison purposes only
-    if (g_superfluous_prescans) {
+    if (m_options.superfluousPrescans) {
       for (uint axis=0;axis<3;axis++) {
         for (uint i=begin_idx[axis]; i<end_idx[axis]; i++) {
           for (uint j=0;j<table.tri_tab[i]->membership_size;j++) {
-            unsigned char l=table.tri_tab[i]->membership[j];
+            uint l=table.tri_tab[i]->membership[j];
             if (table.edgeType_tab[i] == END) {
               running[l][1]--;
             }
@@ -116,7 +135,7 @@ void KdTreeAccel::sequential_build(v_BoxEdge_inplace &boxEdges, TAB &table,
     for (uint axis=0;axis<3;axis++) {
       for (uint i=begin_idx[axis]; i<end_idx[axis]; i++) {
         for (uint j=0;j<table.tri_tab[i]->membership_size;j++) {
-          unsigned char l=table.tri_tab[i]->membership[j];
+          uint l=table.tri_tab[i]->membership[j];
           if (table.edgeType_tab[i] == END) {
             running[l][1]--;
           }
@@ -142,6 +161,14 @@ void KdTreeAccel::sequential_build(v_BoxEdge_inplace &boxEdges, TAB &table,
       }
     }
     
+    delete [] running;
+    if (checkCancel()) {
+      delete [] memo;
+      break;
+    }
+
+    findBestPlaneTrace.end();
+    findBestPlanePerf.end();
     RECORD_TIME(
       stats.findBestPlane_usec[level][1],
       stats.findBestPlane[level][1]);
@@ -150,6 +177,8 @@ void KdTreeAccel::sequential_build(v_BoxEdge_inplace &boxEdges, TAB &table,
     RECORD_TIME(
       stats.newGen_usec[level][0],
       stats.newGen[level][0]);
+    TraceScope newGenTrace(m_tracer, "newgen", level);
+    PerfScope newGenPerf(m_perf, PERF_NEWGEN);
 
     vp_KdTreeNode_inplace *newLive = new vp_KdTreeNode_inplace(); // next gen live
     KdTreeNode_inplace *newNode;
@@ -160,6 +189,7 @@ void KdTreeAccel::sequential_build(v_BoxEdge_inplace &boxEdges, TAB &table,
           && sah.m_Ci * (*live)[i]->triangleCount > memo[i].SAH) {
         // set splitEdge
         (*live)[i]->splitEdge = &boxEdges[memo[i].split];
+        uint childIdx = packSplit((*live)[i]);
         
         // pull two at the end and make them left and right for this kdTreeNode
         // keep out the ones that are empty from newLive
@@ -169,7 +199,7 @@ void KdTreeAccel::sequential_build(v_BoxEdge_inplace &boxEdges, TAB &table,
           newNode->extent = (*live)[i]->extent;
           newNode->extent.max[(*live)[i]->splitEdge->axis]
             = (*live)[i]->splitEdge->t;
-          newNode->triangleIndices = new vector<int>();
+          newNode->packedIdx = childIdx;
           newNode->triangleCount = memo[i].nA;
           newLive->push_back(newNode);
           (*live)[i]->left = newNode;
@@ -181,14 +211,18 @@ void KdTreeAccel::sequential_build(v_BoxEdge_inplace &boxEdges, TAB &table,
           newNode->extent = (*live)[i]->extent;
           newNode->extent.min[(*live)[i]->splitEdge->axis]
             = (*live)[i]->splitEdge->t;
-          newNode->triangleIndices = new vector<int>();
+          newNode->packedIdx = childIdx+1;
           newNode->triangleCount = memo[i].nB;
           newLive->push_back(newNode);
           (*live)[i]->right = newNode;
         }
+      } else {
+        packLeaf((*live)[i]);
       }
     }
 
+    newGenTrace.end();
+    newGenPerf.end();
     RECORD_TIME(
       stats.newGen_usec[level][1],
       stats.newGen[level][1]);
@@ -197,15 +231,23 @@ void KdTreeAccel::sequential_build(v_BoxEdge_inplace &boxEdges, TAB &table,
     RECORD_TIME(
       stats.classifyTriangles_usec[level][0],
       stats.classifyTriangles[level][0]);
+    TraceScope classifyTrianglesTrace(m_tracer, "classify", level, -1, tris.size());
+    PerfScope classifyTrianglesPerf(m_perf, PERF_CLASSIFYTRIANGLES);
+
+    uint *cursor = new uint[live->size()]; // next item of each node that stays a leaf
+    for (uint l=0;l<live->size();l++) {
+      cursor[l] = (*live)[l]->itemOffset;
+    }
 
     for (v_Triangle_aux::iterator I=tris.begin(), E=tris.end(); I!=E; I++) {
       Triangle_aux &tri = *I;
       unsigned char old_membership_size = tri.membership_size;
-      unsigned char old_membership[11];
-      memcpy(old_membership, tri.membership, tri.membership_size);
+      membership_t old_membership[11];
+      memcpy(old_membership, tri.membership,
+             sizeof(membership_t)*tri.membership_size);
 
       // reset membership
-      memset(tri.membership, 0, tri.membership_size);
+      memset(tri.membership, 0, sizeof(membership_t)*tri.membership_size);
       tri.membership_size = 0;
 
       for (uint j=0;j<old_membership_size;j++) {
@@ -240,7 +282,7 @@ void KdTreeAccel::sequential_build(v_BoxEdge_inplace &boxEdges, TAB &table,
             memo[l].straddle++;
           }
         } else { // not split
-          A->triangleIndices->push_back(tri.triangleIndex);
+          m_packedItems[cursor[l]++] = tri.triangleIndex;
         }
         if (tri.membership_size > 11) {
           cout << "Fatal: Can't handle triangles belonging to more than 11 nodes." << endl;
@@ -249,12 +291,16 @@ void KdTreeAccel::sequential_build(v_BoxEdge_inplace &boxEdges, TAB &table,
       }
     }
 
+    delete [] cursor;
+
+    classifyTrianglesTrace.end();
+    classifyTrianglesPerf.end();
     RECORD_TIME(
       stats.classifyTriangles_usec[level][1],
       stats.classifyTriangles[level][1]);
 
     // print the split edge
-    if (ver_splitedge) {
+    if (m_options.printSplitEdges) {
       for (uint i=0;i<live->size();i++) {
         if (memo[i].split < boxEdges.size() && 
             memo[i].SAH < numeric_limits<float>::max()) {
@@ -272,28 +318,54 @@ void KdTreeAccel::sequential_build(v_BoxEdge_inplace &boxEdges, TAB &table,
       }
     }
 
+    reportProgress(level, live->size(), boxEdges.size());
+
+    delete [] memo;
+    delete live;
     live = newLive;
     base = (*live)[live->size()-1];
+
+    if (snapshotAt(level+1)) {
+      takeSnapshot(level+1, tris, live);
+    }
+  }
+
+  if (cancelled()) {
+    delete live;
+    return;
   }
 
   // FILL - final pass to fill in the tree
   RECORD_TIME(
     stats.fill_usec[0],
     stats.fill[0]);
+  TraceScope fillTrace(m_tracer, "fill", -1, -1, tris.size());
+  PerfScope fillPerf(m_perf, PERF_FILL);
 
+  uint *cursor = new uint[live->size()];
+  for (uint l=0;l<live->size();l++) {
+    packLeaf((*live)[l]);
+    cursor[l] = (*live)[l]->itemOffset;
+  }
   for (v_Triangle_aux::iterator I=tris.begin(), E=tris.end();
        I!=E; I++) {
     Triangle_aux &tri = *I;
     for (uint j=0;j<tri.membership_size;j++) {
-      unsigned char l=tri.membership[j];
-      (*live)[l]->triangleIndices->push_back(tri.triangleIndex);
+      uint l=tri.membership[j];
+      m_packedItems[cursor[l]++] = tri.triangleIndex;
     }
   }
-  
+
+  delete [] cursor;  
+  fillTrace.end();
+  fillPerf.end();
   RECORD_TIME(
     stats.fill_usec[1],
     stats.fill[1]);
 
+  reportProgress(level, live->size(), 0);
+  delete live;
+
   m_root = root_;
 
   RECORD_TIME(
@@ -40,13 +40,11 @@
 #ifndef _KDTREENODE_INPLACE_H_
 #define _KDTREENODE_INPLACE_H_
 
-#include <tbb/concurrent_vector.h>
-
 #include "KdTreeNode.h"
 
 class KdTreeNode_inplace : public KdTreeNode {
 public:
-  KdTreeNode_inplace() : triangleCount(0), cc_triangleIndices(NULL) {
+  KdTreeNode_inplace() : triangleCount(0), packedIdx(0), itemOffset(0) {
     custom_mm = true; // we're going to use bump-pointer allocator
   }
 
@@ -56,7 +54,10 @@ public:
   // -- needed since we no longer move boxEdge/s around
   uint triangleCount;
 
-  tbb::concurrent_vector<int> *cc_triangleIndices;
+  // where the node went in the packed tree (KdTreeAccel_base::m_packedNodes)
+  // and, once it is a leaf, where its triangles start in m_packedItems
+  uint packedIdx;
+  uint itemOffset;
 };
 
 #endif // _KDTREENODE_INPLACE_H_
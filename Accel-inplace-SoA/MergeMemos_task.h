@@ -0,0 +1,122 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _MERGEMEMOS_TASK_H_
+#define _MERGEMEMOS_TASK_H_
+
+#include <cstring>
+#include <limits>
+
+#include <tbb/blocked_range.h>
+
+#include "PrescanTab.h"
+#include "SplitMemo.h"
+#include "TAB.h"
+
+// parallel_for bodies over the live nodes for findBestPlane's two
+// reductions across the [axis][chunk][live node] tables; every node's
+// column is independent of the others.
+
+// pass each axis's prescan counts forward from chunk to chunk
+class PrescanMerge_task {
+public:
+  PrescanMerge_task(PrescanTab *pre_tab, uint numThreads, uint numLive)
+    : pre_tab(pre_tab), numThreads(numThreads), numLive(numLive) {}
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    for (uint k=range.begin();k!=range.end();k++) {
+      for (uint i=0;i<3;i++) {
+        for (uint j=0;j<numThreads-2;j++) {
+          const PrescanTab &from = at(i, j, k);
+          PrescanTab &to = at(i, j+1, k);
+          to.nA += from.nA;
+          to.nB += from.nB;
+        }
+      }
+    }
+  }
+
+private:
+  PrescanTab &at(uint axis, uint chunk, uint l) const {
+    return pre_tab[(axis*numThreads + chunk)*numLive + l];
+  }
+
+  PrescanTab *pre_tab; // [axis][chunk][live node]
+  const uint numThreads, numLive;
+};
+
+// the cheapest split of each live node over all axes and chunks; with a
+// compacted table, split is turned back into an index into boxEdges
+class MemoMerge_task {
+public:
+  MemoMerge_task(const SplitMemo *memos, SplitMemo *memo, uint numThreads,
+                 uint numLive, const TAB *compacted = NULL,
+                 const BoxEdge_inplace *boxEdges = NULL)
+    : memos(memos), memo(memo), numThreads(numThreads), numLive(numLive),
+      compacted(compacted), boxEdges(boxEdges) {}
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    for (uint l=range.begin();l!=range.end();l++) {
+      memcpy(&memo[l], &memos[l], sizeof(SplitMemo));
+      for (uint k=0;k<3;k++) {
+        for (uint t=0;t<numThreads;t++) {
+          const SplitMemo &m = memos[(k*numThreads + t)*numLive + l];
+          if (memo[l].SAH > m.SAH) {
+            memcpy(&memo[l], &m, sizeof(SplitMemo));
+          }
+        }
+      }
+      if (compacted && memo[l].SAH < std::numeric_limits<float>::max()) {
+        uint i = memo[l].split;
+        uint type = (compacted->edgeType_tab[i] == START) ? 0 : 1;
+        memo[l].split =
+          compacted->tri_tab[i]->edges[2*memo[l].axis + type] - boxEdges;
+      }
+    }
+  }
+
+private:
+  const SplitMemo *memos; // [axis][chunk][live node]
+  SplitMemo *memo;
+  const uint numThreads, numLive;
+  const TAB *compacted;
+  const BoxEdge_inplace *boxEdges;
+};
+
+#endif // _MERGEMEMOS_TASK_H_
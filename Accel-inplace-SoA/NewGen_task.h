@@ -0,0 +1,190 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _NEWGEN_TASK_H_
+#define _NEWGEN_TASK_H_
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_scan.h>
+
+#include "SAH.h"
+#include "MantaKDTreeNode.h"
+#include "SplitMemo.h"
+
+// where NEWGEN puts what a live node turns into, counted from the level's
+// starts: its pair of packed child slots if it splits, its item range if
+// it stays a leaf, and its children's places in the next live list
+struct NewGenSlot {
+  uint node, item, child;
+  bool split;
+};
+
+// parallel_scan body: the exclusive prefix sums of the three counts over
+// the live nodes, so the slots come out where the sequential loop put
+// them. A NULL memo makes leaves of all of them (the final fill).
+class NewGenScan {
+public:
+  NewGenScan(const vp_KdTreeNode_inplace *live, const SplitMemo *memo,
+             const SAH &sah, NewGenSlot *slots)
+    : nodes(0), items(0), children(0),
+      live(live), memo(memo), sah(sah), slots(slots) {}
+
+  NewGenScan(NewGenScan &other, tbb::split)
+    : nodes(0), items(0), children(0), live(other.live), memo(other.memo),
+      sah(other.sah), slots(other.slots) {}
+
+  template<typename Tag>
+  void operator()(const tbb::blocked_range<uint> &range, Tag) {
+    for (uint i=range.begin();i!=range.end();i++) {
+      KdTreeNode_inplace *A = (*live)[i];
+      // if it's worth splitting
+      bool split = memo && A->triangleCount > 0
+        && sah.m_Ci * A->triangleCount > memo[i].SAH;
+      if (Tag::is_final_scan()) {
+        slots[i].node = nodes;
+        slots[i].item = items;
+        slots[i].child = children;
+        slots[i].split = split;
+      }
+      if (split) {
+        nodes += 2;
+        children += (memo[i].nA != 0) + (memo[i].nB != 0);
+      } else {
+        items += A->triangleCount;
+      }
+    }
+  }
+
+  void reverse_join(NewGenScan &left) {
+    nodes += left.nodes;
+    items += left.items;
+    children += left.children;
+  }
+
+  void assign(NewGenScan &other) {
+    nodes = other.nodes;
+    items = other.items;
+    children = other.children;
+  }
+
+  // totals, after the scan
+  uint nodes, items, children;
+
+private:
+  const vp_KdTreeNode_inplace *live;
+  const SplitMemo *memo;
+  const SAH &sah;
+  NewGenSlot *slots;
+};
+
+// parallel_for body: each live node fills in its slots; what packSplit()
+// and packLeaf() do one node at a time
+class NewGen_task {
+public:
+  NewGen_task(const vp_KdTreeNode_inplace *live, const SplitMemo *memo,
+              const NewGenSlot *slots, BoxEdge_inplace *boxEdges,
+              MantaKDTreeNode *packedNodes, uint nodeBase, uint itemBase,
+              KdTreeNode_inplace *frontier, vp_KdTreeNode_inplace *newLive)
+    : live(live), memo(memo), slots(slots), boxEdges(boxEdges),
+      packedNodes(packedNodes), nodeBase(nodeBase), itemBase(itemBase),
+      frontier(frontier), newLive(newLive) {}
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    for (uint i=range.begin();i!=range.end();i++) {
+      KdTreeNode_inplace *A = (*live)[i];
+      const NewGenSlot &slot = slots[i];
+      MantaKDTreeNode &packedNode = packedNodes[A->packedIdx];
+
+      if (!slot.split) {
+        A->itemOffset = itemBase + slot.item;
+        packedNode.isLeaf = true;
+        packedNode.numPrimitives = A->triangleCount;
+        packedNode.childIdx = A->itemOffset;
+        continue;
+      }
+
+      A->splitEdge = &boxEdges[memo[i].split];
+      uint childIdx = nodeBase + slot.node;
+      MantaKDTreeNode empty = MantaKDTreeNode();
+      empty.isLeaf = true;
+      empty.numPrimitives = 0;
+      empty.childIdx = itemBase + slot.item;
+      packedNodes[childIdx] = empty;   // left
+      packedNodes[childIdx+1] = empty; // right
+
+      packedNode.isLeaf = false;
+      packedNode.planePos = A->splitEdge->t;
+      packedNode.planeDim = A->splitEdge->axis;
+      packedNode.childIdx = childIdx;
+
+      // empty children stay out of the next live list
+      uint child = slot.child;
+      if (memo[i].nA != 0) {
+        KdTreeNode_inplace *newNode = &frontier[child];
+        newNode->extent = A->extent;
+        newNode->extent.max[A->splitEdge->axis] = A->splitEdge->t;
+        newNode->packedIdx = childIdx;
+        newNode->triangleCount = memo[i].nA;
+        (*newLive)[child++] = newNode;
+        A->left = newNode;
+      }
+      if (memo[i].nB != 0) {
+        KdTreeNode_inplace *newNode = &frontier[child];
+        newNode->extent = A->extent;
+        newNode->extent.min[A->splitEdge->axis] = A->splitEdge->t;
+        newNode->packedIdx = childIdx+1;
+        newNode->triangleCount = memo[i].nB;
+        (*newLive)[child++] = newNode;
+        A->right = newNode;
+      }
+    }
+  }
+
+private:
+  const vp_KdTreeNode_inplace *live;
+  const SplitMemo *memo;
+  const NewGenSlot *slots;
+  BoxEdge_inplace *boxEdges;
+  MantaKDTreeNode *packedNodes;
+  const uint nodeBase, itemBase;   // the packed arrays' sizes before the level
+  KdTreeNode_inplace *frontier;    // first unused node object
+  vp_KdTreeNode_inplace *newLive;  // sized to the scan's children total
+};
+
+#endif // _NEWGEN_TASK_H_
@@ -0,0 +1,174 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _SEGMENTEDFINDBESTPLANE_TASK_H_
+#define _SEGMENTEDFINDBESTPLANE_TASK_H_
+
+#include <cstring>
+#include <limits>
+
+#include <tbb/blocked_range.h>
+
+#include "SAH.h"
+#include "PrescanTab.h"
+#include "SplitMemo.h"
+#include "Segments.h"
+
+// --segmented: findBestPlane as a segmented scan, as parallel_for bodies
+// over the pieces [axis][piece] and then the live nodes. A piece belongs
+// to one node, so its sweep keeps that node's counts and best split in
+// locals instead of looking the node up for every edge.
+
+// nAnB prescan: the STARTs and ENDs in each piece that has another after
+// it in its run
+class SegmentCount_task {
+public:
+  SegmentCount_task(const Segments &segments, PrescanTab *counts)
+    : segments(segments), counts(counts) {}
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    uint pieces = segments.numPieces();
+    for (uint r=range.begin();r!=range.end();r++) {
+      uint k = r / pieces, q = r % pieces;
+      uint nA = 0, nB = 0;
+      if (!segments.lastPiece(q)) {
+        uint end = k*segments.size + segments.pieceBegin[q+1];
+        for (uint j=k*segments.size + segments.pieceBegin[q];j<end;j++) {
+          if (segments.edgeType[j] == END) {
+            nB++;
+          }
+          if (segments.edgeType[j] == START) {
+            nA++;
+          }
+        }
+      }
+      counts[r].nA = nA;
+      counts[r].nB = nB;
+    }
+  }
+
+private:
+  const Segments &segments;
+  PrescanTab *counts; // [axis][piece]
+};
+
+// nAnB final-scan + SAH, from each piece's carry; split is the index of
+// the edge in the proxy, found through its triangle
+class SegmentSweep_task {
+public:
+  SegmentSweep_task(const Segments &segments,
+                    const vp_KdTreeNode_inplace *live, const PrescanTab *carry,
+                    SplitMemo *memos, const SAH &sah,
+                    const BoxEdge_inplace *boxEdges)
+    : segments(segments), live(live), carry(carry), memos(memos), sah(sah),
+      boxEdges(boxEdges) {}
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    uint pieces = segments.numPieces();
+    for (uint r=range.begin();r!=range.end();r++) {
+      uint k = r / pieces, q = r % pieces;
+      const KdTreeNode_inplace *A = (*live)[segments.pieceNode[q]];
+      uint count = A->triangleCount;
+      uint nA = carry[r].nA, nB = carry[r].nB;
+
+      SplitMemo &memo = memos[r];
+      memset(&memo, 0, sizeof(SplitMemo));
+      memo.SAH = std::numeric_limits<float>::max();
+
+      uint end = k*segments.size + segments.pieceBegin[q+1];
+      for (uint j=k*segments.size + segments.pieceBegin[q];j<end;j++) {
+        if (segments.edgeType[j] == END) {
+          nB++;
+        }
+        float SAH = sah(A->extent, k, nA, count-nB, segments.t[j]);
+        if (SAH < memo.SAH) {
+          memo.SAH = SAH;
+          memo.nA = nA;
+          memo.nB = count-nB;
+          memo.split =
+            segments.tri[j]->edges[2*k + segments.edgeType[j]] - boxEdges;
+          memo.axis = k;
+        }
+        if (segments.edgeType[j] == START) {
+          nA++;
+        }
+      }
+    }
+  }
+
+private:
+  const Segments &segments;
+  const vp_KdTreeNode_inplace *live;
+  const PrescanTab *carry; // [axis][piece]
+  SplitMemo *memos;        // [axis][piece]
+  const SAH &sah;
+  const BoxEdge_inplace *boxEdges;
+};
+
+// the cheapest split of each live node over its pieces, in axis and sweep
+// order: the same one the flat sweep picks
+class SegmentMerge_task {
+public:
+  SegmentMerge_task(const Segments &segments, const SplitMemo *memos,
+                    SplitMemo *memo)
+    : segments(segments), memos(memos), memo(memo) {}
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    uint pieces = segments.numPieces();
+    for (uint l=range.begin();l!=range.end();l++) {
+      memset(&memo[l], 0, sizeof(SplitMemo));
+      memo[l].SAH = std::numeric_limits<float>::max();
+      for (uint k=0;k<3;k++) {
+        for (uint q=segments.firstPiece[l];q<segments.firstPiece[l+1];q++) {
+          const SplitMemo &m = memos[k*pieces + q];
+          if (memo[l].SAH > m.SAH) {
+            memcpy(&memo[l], &m, sizeof(SplitMemo));
+          }
+        }
+      }
+    }
+  }
+
+private:
+  const Segments &segments;
+  const SplitMemo *memos; // [axis][piece]
+  SplitMemo *memo;
+};
+
+#endif // _SEGMENTEDFINDBESTPLANE_TASK_H_
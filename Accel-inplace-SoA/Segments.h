@@ -0,0 +1,78 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _SEGMENTS_H_
+#define _SEGMENTS_H_
+
+#include <vector>
+
+#include <tbb/scalable_allocator.h>
+
+#include "OutOfCore.h"
+#include "Triangle_aux.h"
+
+// --segmented: the live nodes' edges, grouped by node. Each axis holds the
+// nodes' runs back to back in live order, each run in sort order, so a
+// node's sweep is one stretch of the columns and needs no membership
+// lookups. The runs are cut into pieces of at most pieceSize edges for
+// the parallel passes over them; the pieces are the same on all axes.
+struct Segments {
+  explicit Segments(const char *outOfCoreDir = NULL)
+    : t(OutOfCoreAllocator<float>(outOfCoreDir)),
+      tri(OutOfCoreAllocator<Triangle_aux*>(outOfCoreDir)), size(0),
+      pieceSize(0) { }
+
+  // [axis*size + i]; edgeType is a byte per edge, not a std::vector<bool>,
+  // since neighbouring pieces are written by different threads
+  std::vector< float, OutOfCoreAllocator<float> > t;
+  std::vector< unsigned char, tbb::scalable_allocator<unsigned char> > edgeType;
+  std::vector< Triangle_aux*, OutOfCoreAllocator<Triangle_aux*> > tri;
+
+  uint size;                    // edges per axis
+  uint pieceSize;
+  std::vector<uint> offset;     // [live node + 1]: its run's start in an axis
+  std::vector<uint> firstPiece; // [live node + 1]
+  std::vector<uint> pieceBegin; // [piece + 1]: its start in an axis
+  std::vector<uint> pieceNode;  // [piece]: the live node it belongs to
+
+  uint numPieces() const { return pieceNode.size(); }
+  bool lastPiece(uint q) const { return q+1 == firstPiece[pieceNode[q]+1]; }
+};
+
+#endif // _SEGMENTS_H_
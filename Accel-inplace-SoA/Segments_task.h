@@ -0,0 +1,272 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _SEGMENTS_TASK_H_
+#define _SEGMENTS_TASK_H_
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_scan.h>
+
+#include "PrescanTab.h"
+#include "Segments.h"
+#include "TAB.h"
+
+// --segmented: parallel_scan/parallel_for bodies that lay the live nodes'
+// runs out and regroup the edges from one level's runs into the next's.
+
+// exclusive prefix sum of the runs' lengths, two edges per triangle on
+// each axis: the runs' starts
+class SegmentOffsetsScan {
+public:
+  SegmentOffsetsScan(const vp_KdTreeNode_inplace *live, uint *offset)
+    : total(0), live(live), offset(offset) {}
+  SegmentOffsetsScan(SegmentOffsetsScan &other, tbb::split)
+    : total(0), live(other.live), offset(other.offset) {}
+
+  template<typename Tag>
+  void operator()(const tbb::blocked_range<uint> &range, Tag) {
+    for (uint l=range.begin();l!=range.end();l++) {
+      if (Tag::is_final_scan()) offset[l] = total;
+      total += 2*(*live)[l]->triangleCount;
+    }
+  }
+  void reverse_join(SegmentOffsetsScan &left) { total += left.total; }
+  void assign(SegmentOffsetsScan &other) { total = other.total; }
+
+  uint total; // edges per axis, after the scan
+
+private:
+  const vp_KdTreeNode_inplace *live;
+  uint *offset;
+};
+
+// the same over the runs' piece counts: the index of each one's first
+class SegmentPiecesScan {
+public:
+  SegmentPiecesScan(const Segments &segments, uint *firstPiece)
+    : total(0), segments(segments), firstPiece(firstPiece) {}
+  SegmentPiecesScan(SegmentPiecesScan &other, tbb::split)
+    : total(0), segments(other.segments), firstPiece(other.firstPiece) {}
+
+  template<typename Tag>
+  void operator()(const tbb::blocked_range<uint> &range, Tag) {
+    for (uint l=range.begin();l!=range.end();l++) {
+      if (Tag::is_final_scan()) firstPiece[l] = total;
+      uint length = segments.offset[l+1] - segments.offset[l];
+      total += (length + segments.pieceSize - 1) / segments.pieceSize;
+    }
+  }
+  void reverse_join(SegmentPiecesScan &left) { total += left.total; }
+  void assign(SegmentPiecesScan &other) { total = other.total; }
+
+  uint total;
+
+private:
+  const Segments &segments;
+  uint *firstPiece;
+};
+
+// each live node cuts its run into pieces
+class SegmentPieces_task {
+public:
+  SegmentPieces_task(Segments &segments) : segments(segments) {}
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    for (uint l=range.begin();l!=range.end();l++) {
+      uint begin = segments.offset[l];
+      for (uint q=segments.firstPiece[l];q<segments.firstPiece[l+1];q++) {
+        segments.pieceBegin[q] = begin;
+        segments.pieceNode[q] = l;
+        begin += segments.pieceSize;
+      }
+    }
+  }
+
+private:
+  Segments &segments;
+};
+
+// the root's runs are the whole table
+class SegmentTable_task {
+public:
+  SegmentTable_task(const TAB &table, Segments &segments)
+    : table(table), segments(segments) {}
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    for (uint i=range.begin();i!=range.end();i++) {
+      segments.t[i] = table.t_tab[i];
+      segments.edgeType[i] = table.edgeType_tab[i];
+      segments.tri[i] = table.tri_tab[i];
+    }
+  }
+
+private:
+  const TAB &table;
+  Segments &segments;
+};
+
+// turns per-piece counts [axis][piece] into each piece's exclusive prefix
+// within its run; a run's last piece's own count is never needed
+class SegmentCarry_task {
+public:
+  SegmentCarry_task(const Segments &segments, PrescanTab *counts,
+                    uint numLive)
+    : segments(segments), counts(counts), numLive(numLive) {}
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    uint pieces = segments.numPieces();
+    for (uint r=range.begin();r!=range.end();r++) {
+      uint k = r / numLive, l = r % numLive;
+      uint nA = 0, nB = 0;
+      for (uint q=segments.firstPiece[l];q<segments.firstPiece[l+1];q++) {
+        PrescanTab &c = counts[k*pieces + q];
+        uint a = c.nA, b = c.nB;
+        c.nA = nA;
+        c.nB = nB;
+        nA += a;
+        nB += b;
+      }
+    }
+  }
+
+private:
+  const Segments &segments;
+  PrescanTab *counts; // [axis][piece]
+  const uint numLive;
+};
+
+// which of A's children a triangle goes to, as in Split_task; the
+// triangle's START and END edges on an axis are always edges[2*axis] and
+// edges[2*axis+1] (see SetupTriangles_task), so the pointers say it all
+#define REGROUP_LEFT  1
+#define REGROUP_RIGHT 2
+
+inline unsigned char regroupSide(const Triangle_aux *tri,
+                                 const BoxEdge *splitEdge) {
+  return (tri->edges[2*splitEdge->axis] < splitEdge ? REGROUP_LEFT : 0)
+    | (tri->edges[2*splitEdge->axis + 1] > splitEdge ? REGROUP_RIGHT : 0);
+}
+
+// where each edge of a split node goes, and how many of each piece's go
+// to the left (nA) and the right child (nB); the edges of nodes that stay
+// leaves go nowhere
+class RegroupCount_task {
+public:
+  RegroupCount_task(const Segments &segments,
+                    const vp_KdTreeNode_inplace *live, unsigned char *side,
+                    PrescanTab *counts)
+    : segments(segments), live(live), side(side), counts(counts) {}
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    uint pieces = segments.numPieces();
+    for (uint r=range.begin();r!=range.end();r++) {
+      uint k = r / pieces, q = r % pieces;
+      const KdTreeNode_inplace *A = (*live)[segments.pieceNode[q]];
+      uint nA = 0, nB = 0;
+      if (A->splitEdge) {
+        uint end = k*segments.size + segments.pieceBegin[q+1];
+        for (uint j=k*segments.size + segments.pieceBegin[q];j<end;j++) {
+          side[j] = regroupSide(segments.tri[j], A->splitEdge);
+          nA += side[j] & REGROUP_LEFT;
+          nB += side[j] >> 1;
+        }
+      }
+      counts[r].nA = nA;
+      counts[r].nB = nB;
+    }
+  }
+
+private:
+  const Segments &segments;
+  const vp_KdTreeNode_inplace *live;
+  unsigned char *side;  // [axis*size + i]
+  PrescanTab *counts;   // [axis][piece]
+};
+
+// stable segmented partition: each piece copies its edges into its
+// children's runs in next, from where the pieces before it left off
+class Regroup_task {
+public:
+  Regroup_task(const Segments &segments, Segments &next,
+               const vp_KdTreeNode_inplace *live, KdTreeNode_inplace *base,
+               const unsigned char *side, const PrescanTab *carry)
+    : segments(segments), next(next), live(live), base(base), side(side),
+      carry(carry) {}
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    uint pieces = segments.numPieces();
+    for (uint r=range.begin();r!=range.end();r++) {
+      uint k = r / pieces, q = r % pieces;
+      const KdTreeNode_inplace *A = (*live)[segments.pieceNode[q]];
+      if (!A->splitEdge) continue;
+
+      // children with no triangles get no edges, and aren't looked up
+      uint left = 0, right = 0;
+      if (A->left) {
+        left = k*next.size + next.offset[index(A->left, base)-1] + carry[r].nA;
+      }
+      if (A->right) {
+        right = k*next.size + next.offset[index(A->right, base)-1] + carry[r].nB;
+      }
+      uint end = k*segments.size + segments.pieceBegin[q+1];
+      for (uint j=k*segments.size + segments.pieceBegin[q];j<end;j++) {
+        if (side[j] & REGROUP_LEFT) {
+          next.t[left] = segments.t[j];
+          next.edgeType[left] = segments.edgeType[j];
+          next.tri[left++] = segments.tri[j];
+        }
+        if (side[j] & REGROUP_RIGHT) {
+          next.t[right] = segments.t[j];
+          next.edgeType[right] = segments.edgeType[j];
+          next.tri[right++] = segments.tri[j];
+        }
+      }
+    }
+  }
+
+private:
+  const Segments &segments;
+  Segments &next;
+  const vp_KdTreeNode_inplace *live;
+  KdTreeNode_inplace *base;
+  const unsigned char *side; // [axis*size + i]
+  const PrescanTab *carry;   // [axis][piece]
+};
+
+#endif // _SEGMENTS_TASK_H_
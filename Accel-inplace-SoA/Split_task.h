@@ -41,24 +41,35 @@
 #define _SPLIT_TASK_H_
 
 #include <iostream>
+#include <string.h>
 
 #include <tbb/task.h>
+#include <tbb/atomic.h>
+
+#include "Tracer.h"
 
 class Split_task : public tbb::task {
 public:
   Split_task(v_Triangle_aux &tris, vp_KdTreeNode_inplace *live, 
-             KdTreeNode_inplace *base, uint begin, uint end, uint inst_idx) 
-    : tris(tris), live(live), base(base), begin(begin), end(end), inst_idx(inst_idx) {}
+             KdTreeNode_inplace *base, uint begin, uint end, uint inst_idx,
+             Tracer *tracer, uint level, int *items,
+             tbb::atomic<uint> *leafCursors, uint *leafOffsets) 
+    : tris(tris), live(live), base(base), begin(begin), end(end), inst_idx(inst_idx),
+      tracer(tracer), level(level), items(items), leafCursors(leafCursors),
+      leafOffsets(leafOffsets) {}
 
   tbb::task *execute() {
+    TraceScope trace(tracer, "classify", level, -1, end-begin);
+
     for (uint i = begin; i < end; i++) {
       Triangle_aux &tri = tris[i];
       unsigned char old_membership_size = tri.membership_size;
-      unsigned char old_membership[11];
-      memcpy(old_membership, tri.membership, tri.membership_size);
+      membership_t old_membership[11];
+      memcpy(old_membership, tri.membership,
+             sizeof(membership_t)*tri.membership_size);
       
       // reset membership
-      memset(tri.membership, 0, tri.membership_size);
+      memset(tri.membership, 0, sizeof(membership_t)*tri.membership_size);
       tri.membership_size = 0;
       
       for (uint j=0;j<old_membership_size;j++) {
@@ -82,8 +93,10 @@ public:
           if (end->edgeType == END && end > A->splitEdge) {
             tri.membership[tri.membership_size++] = index(C,base)-1;
           }
+        } else if (leafOffsets) { // not split, deterministic
+          items[leafOffsets[l]++] = tri.triangleIndex;
         } else { // not split
-          A->cc_triangleIndices->push_back(tri.triangleIndex);
+          items[leafCursors[l]++] = tri.triangleIndex;
         }
 
         if (tri.membership_size > 11) {
@@ -104,6 +117,14 @@ private:
   const KdTreeNode_inplace *const base;
   // for instrumentation
   uint inst_idx;
+  Tracer *tracer;
+  const uint level;
+  // the packed item array and where the next triangle of each unsplit live
+  // node goes in it: shared cursors, or this chunk's own offsets in
+  // deterministic mode (see LeafCount_task)
+  int *items;
+  tbb::atomic<uint> *leafCursors;
+  uint *leafOffsets;
 };
 
 #endif // _SPLIT_TASK_H_
@@ -41,15 +41,33 @@
 #include <cstring>
 
 #include "Stats.h"
-#include "options.h"
 
 using namespace std;
 
-Stats::Stats(uint maxDepth) : Stats_base(maxDepth) {
+Stats::Stats(uint maxDepth)
+  : Stats_base(maxDepth), start(0), init_CreateEdges(0), init_sort(0),
+    init_SetupTriangles(0), init_unpack(0), init_finish(0), build_start(0),
+    build_finish(0), start_usec(0), init_CreateEdges_usec(0),
+    init_sort_usec(0), init_SetupTriangles_usec(0), init_unpack_usec(0),
+    init_finish_usec(0), build_start_usec(0), build_finish_usec(0) {
   memset(findBestPlane, 0, sizeof(uint64)*32*2);
   memset(newGen, 0, sizeof(uint64)*32*2);
   memset(classifyTriangles, 0, sizeof(uint64)*32*2);
   memset(fill, 0, sizeof(uint64)*2);
+  memset(findBestPlane_usec, 0, sizeof(long int)*32*2);
+  memset(newGen_usec, 0, sizeof(long int)*32*2);
+  memset(classifyTriangles_usec, 0, sizeof(long int)*32*2);
+  memset(fill_usec, 0, sizeof(long int)*2);
+  memset(prescanMerge, 0, sizeof(uint64)*32*2);
+  memset(memoMerge, 0, sizeof(uint64)*32*2);
+  memset(prescanMerge_usec, 0, sizeof(long int)*32*2);
+  memset(memoMerge_usec, 0, sizeof(long int)*32*2);
+  memset(compact, 0, sizeof(uint64)*32*2);
+  memset(compact_usec, 0, sizeof(long int)*32*2);
+  memset(regroup, 0, sizeof(uint64)*32*2);
+  memset(regroup_usec, 0, sizeof(long int)*32*2);
+  memset(flatSweep, 0, sizeof(uint64)*32*2);
+  memset(flatSweep_usec, 0, sizeof(long int)*32*2);
 }
 
 Stats::~Stats() { }
@@ -76,10 +94,39 @@ void Stats::printCSVHeader(std::ostream &out) {
 
   // Fill phase (one-time)
   cerr << ",fill_start,fill_end";
+
+  // FindBestPlane's merges per level
+  for (uint i=0;i<m_maxDepth;i++) {
+    cerr << ",prescanMerge_" << i << "_start"
+         << ",prescanMerge_" << i << "_end";
+  }
+
+  for (uint i=0;i<m_maxDepth;i++) {
+    cerr << ",memoMerge_" << i << "_start"
+         << ",memoMerge_" << i << "_end";
+  }
+
+  // --compact per level (0 where it didn't run)
+  for (uint i=0;i<m_maxDepth;i++) {
+    cerr << ",compact_" << i << "_start"
+         << ",compact_" << i << "_end";
+  }
+
+  // --segmented per level (0 without it)
+  for (uint i=0;i<m_maxDepth;i++) {
+    cerr << ",regroup_" << i << "_start"
+         << ",regroup_" << i << "_end";
+  }
+
+  // --segmented with -v per level (0 otherwise)
+  for (uint i=0;i<m_maxDepth;i++) {
+    cerr << ",flatSweep_" << i << "_start"
+         << ",flatSweep_" << i << "_end";
+  }
 }
 
-void Stats::printCSV(std::ostream &out) {
-  if (g_time_in_ticks) {
+void Stats::printCSV(std::ostream &out, bool inTicks) {
+  if (inTicks) {
     cerr << "," << start
          << "," << init_CreateEdges
          << "," << init_sort
@@ -107,6 +154,35 @@ void Stats::printCSV(std::ostream &out) {
     
     // Fill phase (one-time)
     cerr << "," << fill[0] << "," << fill[1];
+
+    // FindBestPlane's merges per level
+    for (uint i=0;i<m_maxDepth;i++) {
+      cerr << "," << prescanMerge[i][0]
+           << "," << prescanMerge[i][1];
+    }
+
+    for (uint i=0;i<m_maxDepth;i++) {
+      cerr << "," << memoMerge[i][0]
+           << "," << memoMerge[i][1];
+    }
+
+    // --compact per level (0 where it didn't run)
+    for (uint i=0;i<m_maxDepth;i++) {
+      cerr << "," << compact[i][0]
+           << "," << compact[i][1];
+    }
+
+    // --segmented per level (0 without it)
+    for (uint i=0;i<m_maxDepth;i++) {
+      cerr << "," << regroup[i][0]
+           << "," << regroup[i][1];
+    }
+
+    // --segmented with -v per level (0 otherwise)
+    for (uint i=0;i<m_maxDepth;i++) {
+      cerr << "," << flatSweep[i][0]
+           << "," << flatSweep[i][1];
+    }
   } else {
     cerr << "," << start_usec
          << "," << init_CreateEdges_usec
@@ -135,5 +211,34 @@ void Stats::printCSV(std::ostream &out) {
     
     // Fill phase (one-time)
     cerr << "," << fill_usec[0] << "," << fill_usec[1];
+
+    // FindBestPlane's merges per level
+    for (uint i=0;i<m_maxDepth;i++) {
+      cerr << "," << prescanMerge_usec[i][0]
+           << "," << prescanMerge_usec[i][1];
+    }
+
+    for (uint i=0;i<m_maxDepth;i++) {
+      cerr << "," << memoMerge_usec[i][0]
+           << "," << memoMerge_usec[i][1];
+    }
+
+    // --compact per level (0 where it didn't run)
+    for (uint i=0;i<m_maxDepth;i++) {
+      cerr << "," << compact_usec[i][0]
+           << "," << compact_usec[i][1];
+    }
+
+    // --segmented per level (0 without it)
+    for (uint i=0;i<m_maxDepth;i++) {
+      cerr << "," << regroup_usec[i][0]
+           << "," << regroup_usec[i][1];
+    }
+
+    // --segmented with -v per level (0 otherwise)
+    for (uint i=0;i<m_maxDepth;i++) {
+      cerr << "," << flatSweep_usec[i][0]
+           << "," << flatSweep_usec[i][1];
+    }
   } 
 }
@@ -52,7 +52,7 @@ public:
 
   // Mandatory functions
   void printCSVHeader(std::ostream &out);
-  void printCSV(std::ostream &out);
+  void printCSV(std::ostream &out, bool inTicks);
 
   uint64 start, init_CreateEdges, init_sort, init_SetupTriangles, init_unpack;
   uint64 init_finish, build_start, build_finish;
@@ -67,6 +67,24 @@ public:
 
   long int findBestPlane_usec[32][2], newGen_usec[32][2];
   long int classifyTriangles_usec[32][2], fill_usec[2];
+
+  // within findBestPlane: the prescan carry and the memo reduction
+  uint64 prescanMerge[32][2], memoMerge[32][2];
+  long int prescanMerge_usec[32][2], memoMerge_usec[32][2];
+
+  // --compact, on the levels it runs before
+  uint64 compact[32][2];
+  long int compact_usec[32][2];
+
+  // --segmented: laying out the runs each level sweeps (the regroup after
+  // the level before, or the table's copy for level 0)
+  uint64 regroup[32][2];
+  long int regroup_usec[32][2];
+
+  // --segmented with -v: the flat sweep over the same level, for the
+  // speedup
+  uint64 flatSweep[32][2];
+  long int flatSweep_usec[32][2];
 };
 
 #endif // _STATS_H_
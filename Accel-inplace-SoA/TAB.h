@@ -44,14 +44,20 @@
 
 #include <tbb/scalable_allocator.h>
 
+#include "OutOfCore.h"
 #include "Triangle_aux.h"
 
 // unpacked array of BoxEdge/s
 struct TAB {
-  std::vector< float, tbb::scalable_allocator<float> > t_tab;
+  // the two big columns go to files with --out-of-core
+  explicit TAB(const char *outOfCoreDir = NULL)
+    : t_tab(OutOfCoreAllocator<float>(outOfCoreDir)),
+      tri_tab(OutOfCoreAllocator<Triangle_aux*>(outOfCoreDir)) { }
+
+  std::vector< float, OutOfCoreAllocator<float> > t_tab;
   std::vector< bool, tbb::scalable_allocator<bool> > edgeType_tab; // std::vector<bool> is a specialization
   std::vector< char, tbb::scalable_allocator<char> > axis_tab;
-  std::vector< Triangle_aux*, tbb::scalable_allocator<Triangle_aux*> > tri_tab;
+  std::vector< Triangle_aux*, OutOfCoreAllocator<Triangle_aux*> > tri_tab;
 };
 
 #endif // _TAB_H_
@@ -42,10 +42,12 @@
 
 #include "BoxEdge_inplace.h"
 
+typedef unsigned int membership_t;
+
 // auxiliary class to represent relationship among boxEdge/s
 // this is separate from class triangle for following reasons
 // 1. This is used only internally in the construction phase
-// 2. smaller size (fits in a cache line)
+// 2. smaller size (no vertices, just what the build needs)
 // 3. Will in-place sort to have same ordering as Xs -- primary use case
 //    --> regular memory access pattern
 struct Triangle_aux {
@@ -53,7 +55,8 @@ struct Triangle_aux {
   BoxEdge_inplace *edges[6];
   unsigned int triangleIndex;
   unsigned char membership_size;
-  unsigned char membership[11];
+  // indices into the live set, which outgrows a byte past ~8 levels
+  membership_t membership[11];
 };
 
 #endif // _TRIANGLE_AUX_H_
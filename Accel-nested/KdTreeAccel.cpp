@@ -41,28 +41,30 @@
 #include <vector>
 #include <iomanip>
 #include <stdio.h>
+#include <string.h>
 
 #include <tbb/parallel_reduce.h>
 #include <tbb/parallel_sort.h>
 #include <tbb/atomic.h>
 #include <tbb/task_scheduler_observer.h>
 #include <tbb/tick_count.h>
-#include <tbb/task_scheduler_init.h>
 
 #include "KdTreeAccel.h"
+#include "LazyKdTreeNode.h"
 #include "ParKdTreeNested_task.h"
 #include "ParKdTreeNested_np_task.h"
 #include "timers.h"
-#include "TriangleMesh.h"
+#include "GeometryView.h"
 #include "BoundingBox.h"
-#include "options.h"
+#include "Tracer.h"
+#include "PerfCounters.h"
 
 using namespace std;
 using namespace tbb;
 
-KdTreeAccel::KdTreeAccel(TriangleMesh * mesh, unsigned int numThreads,
-                         unsigned int maxDepth) 
-  : KdTreeAccel_base(mesh, numThreads, maxDepth), stats(maxDepth) { }
+KdTreeAccel::KdTreeAccel(const GeometryView &geometry,
+                         const BuildOptions &options)
+  : KdTreeAccel_base(geometry, options), stats(options.maxDepth) { }
 
 string KdTreeAccel::impl_string() {
   return string("Nested version");
@@ -74,11 +76,16 @@ void KdTreeAccel::build() {
   RECORD_TIME(
     stats.start_usec,
     stats.start);
+  beginBuild();
+  PerfScope createEdgesPerf(m_perf, PERF_CREATEEDGES);
+
+  // the last build's edges
+  vv_BoxEdge().swap(m_edges);
 
   // root node
   m_root = new KdTreeNode();
-  // bounding box for the root node
-  BoundingBox &nodeExtent = *new BoundingBox(m_mesh->boundingBox);
+  // bounding box for the root node, grown as the edges are created
+  BoundingBox nodeExtent;
 
   // list of boxedges
   vv_BoxEdge boxEdgeList(3);
@@ -86,13 +93,10 @@ void KdTreeAccel::build() {
   // construct list of triangle indices (0...n-1),
   // where n is number of triangles
   vector<int, tbb::scalable_allocator<int> > triangleIndices;
-  for (int i = 0; i < (int)(m_mesh->triangleList.size()); i++) {
+  for (int i = 0; i < (int)(m_geometry.numTriangles()); i++) {
     triangleIndices.push_back(i);
   }
   
-  // init TBB task scheduler
-  task_scheduler_init init(m_numThreads);
-  
   unsigned int n = triangleIndices.size();
   for (unsigned int i=0;i<3;i++) {
       boxEdgeList[i].resize(2*n);
@@ -101,33 +105,44 @@ void KdTreeAccel::build() {
   // init boxedge lists
   for (unsigned int i = 0; i < 3; i++) {
     for (unsigned int j = 0; j < n; j++) {
-      boxEdgeList[i][j*2] = 
-        BoxEdge(m_mesh->triangleList[triangleIndices[j]].bound.min[i], triangleIndices[j], START, i);
-      boxEdgeList[i][j*2+1] = 
-        BoxEdge(m_mesh->triangleList[triangleIndices[j]].bound.max[i], triangleIndices[j], END, i);
+      float lo, hi;
+      m_geometry.bounds(i, triangleIndices[j], lo, hi);
+      if (lo < nodeExtent.min[i]) nodeExtent.min[i] = lo;
+      if (hi > nodeExtent.max[i]) nodeExtent.max[i] = hi;
+      boxEdgeList[i][j*2] = BoxEdge(lo, triangleIndices[j], START, i);
+      boxEdgeList[i][j*2+1] = BoxEdge(hi, triangleIndices[j], END, i);
     }
   }
 
+  createEdgesPerf.end();
   RECORD_TIME(
     stats.init_CreateEdges_usec,
     stats.init_CreateEdges);
+  PerfScope sortPerf(m_perf, PERF_SORT);
 
   // sort the boxedges
-  sort(boxEdgeList[0].begin(), boxEdgeList[0].end());
-  sort(boxEdgeList[1].begin(), boxEdgeList[1].end());
-  sort(boxEdgeList[2].begin(), boxEdgeList[2].end());
+  {
+    TraceScope trace(m_tracer, "sort", -1, -1, 6*n);
+    sort(boxEdgeList[0].begin(), boxEdgeList[0].end());
+    sort(boxEdgeList[1].begin(), boxEdgeList[1].end());
+    sort(boxEdgeList[2].begin(), boxEdgeList[2].end());
+  }
 
+  sortPerf.end();
   RECORD_TIME(
     stats.init_sort_usec,
     stats.init_sort);
-  if (g_time_in_ticks) {
-    stats.build_start = stats.init_finish = stats.init_sort;
-  } else {
-    stats.build_start_usec = stats.init_finish_usec = stats.init_sort_usec;
+  stats.build_start = stats.init_finish = stats.init_sort;
+  stats.build_start_usec = stats.init_finish_usec = stats.init_sort_usec;
+
+  if (checkCancel()) {
+    delete m_root;
+    discardTree();
+    return;
   }
   
   ParKdTreeNested_task& accel = 
-    *new(task::allocate_root()) ParKdTreeNested_task(m_mesh, 
+    *new(task::allocate_root()) ParKdTreeNested_task(&m_geometry, 
                                                      nodeExtent,
                                                      boxEdgeList,
                                                      m_maxDepth, 
@@ -137,11 +152,20 @@ void KdTreeAccel::build() {
                                                      0 /*level*/);
   task::spawn_root_and_wait(accel);
 
+  // whatever the tasks got done before the cancel goes
+  if (cancelled()) {
+    delete m_root;
+    discardTree();
+    return;
+  }
+
+  if (m_options.incremental) {
+    m_edges.swap(boxEdgeList);
+  }
+
   RECORD_TIME(
     stats.build_finish_usec,
     stats.build_finish);
-
-  init.terminate();
 }
 
 KdTreeNode *KdTreeAccel::buildTree_boxEdges(const BoundingBox& nodeExtent,
@@ -149,7 +173,7 @@ KdTreeNode *KdTreeAccel::buildTree_boxEdges(const BoundingBox& nodeExtent,
                                                 int maxDepth) {
   KdTreeNode * newNode = new KdTreeNode();
   unsigned int triangles = boxEdgeList[0].size()/2;
-  if (maxDepth == 0 || triangles == 0) {
+  if (maxDepth == 0 || triangles == 0 || budgetLeftMs() <= 0) {
     newNode->left = NULL;
     newNode->right = NULL;
     newNode->extent = nodeExtent;
@@ -204,7 +228,7 @@ KdTreeNode *KdTreeAccel::buildTree_boxEdges(const BoundingBox& nodeExtent,
       return newNode;
     }
 
-    vector<char> membership(m_mesh->triangleList.size(), 0);
+    vector<char> membership(m_geometry.numTriangles(), 0);
     vv_BoxEdge left(3), right(3);
     unsigned int left_s = 0, right_s = 0;
     v_BoxEdge::const_iterator I = boxEdgeList[bestEdge->axis].begin(),
@@ -246,10 +270,10 @@ KdTreeNode *KdTreeAccel::buildTree_boxEdges(const BoundingBox& nodeExtent,
     // newNode->isLeaf = false;
     // newNode->splitAxis = bestEdge->axis;
     // newNode->splitValue = bestEdge->t;
-    newNode->splitEdge = bestEdge;
+    // bestEdge points into boxEdgeList, which the caller owns
+    newNode->splitEdge = new BoxEdge(*bestEdge);
 
-    //    if (ver_splitedge) {
-    if (true) {
+    if (m_options.printSplitEdges) {
       cerr << 8-maxDepth << " "
            << setprecision(3) << fixed << " [@ " 
            << bestEdge->t << " "
@@ -266,12 +290,63 @@ KdTreeNode *KdTreeAccel::buildTree_boxEdges(const BoundingBox& nodeExtent,
   }
 }
 
+KdTreeNode *KdTreeAccel::allocNode(unsigned int level) {
+  if (m_options.lazyDepth > 0 && level == m_options.lazyDepth) {
+    return new LazyKdTreeNode();
+  }
+  return new KdTreeNode();
+}
+
+bool KdTreeAccel::expandLazy(KdTreeNode *node) {
+  LazyKdTreeNode *lazyNode = static_cast<LazyKdTreeNode*>(node);
+  if (lazyNode->built) return false;
+  tbb::spin_mutex::scoped_lock lock(lazyNode->mutex);
+  if (lazyNode->built) return false;
+
+  // the node's triangles as sorted box edges, as build() makes them for
+  // the whole mesh
+  const vector<int> &triangles = *node->triangleIndices;
+  unsigned int n = triangles.size();
+  vv_BoxEdge boxEdgeList(3);
+  for (unsigned int i = 0; i < 3; i++) {
+    boxEdgeList[i].resize(2*n);
+    for (unsigned int j = 0; j < n; j++) {
+      float lo, hi;
+      m_geometry.bounds(i, triangles[j], lo, hi);
+      boxEdgeList[i][j*2] = BoxEdge(lo, triangles[j], START, i);
+      boxEdgeList[i][j*2+1] = BoxEdge(hi, triangles[j], END, i);
+    }
+    sort(boxEdgeList[i].begin(), boxEdgeList[i].end());
+  }
+
+  graft(node, buildTree_boxEdges(node->extent, boxEdgeList,
+                                 lazyNode->maxDepth));
+  lazyNode->built = true;
+  return true;
+}
+
+void KdTreeAccel::graft(KdTreeNode *node, KdTreeNode *subtree) {
+  // node keeps its place in the parent
+  delete node->left;
+  delete node->right;
+  delete node->splitEdge;
+  delete node->triangleIndices;
+  node->triangleIndices = subtree->triangleIndices;
+  node->splitEdge = subtree->splitEdge;
+  node->left = subtree->left;
+  node->right = subtree->right;
+  subtree->triangleIndices = NULL;
+  subtree->splitEdge = NULL;
+  subtree->left = subtree->right = NULL;
+  delete subtree;
+}
+
 void impl_usage() {
   // TODO
 }
 
 void KdTreeAccel::printTimingStats(ostream &out) {
-  if (g_time_in_ticks) {
+  if (m_options.timeInTicks) {
     // TODO
     out << "     Nested TIMING INFORMATION (in CPU ticks)\n\n";
     
@@ -377,11 +452,8 @@ void KdTreeAccel::printTimingStats(ostream &out) {
 
 void KdTreeAccel::printTimingStatsCSVHeader(std::ostream &out) {
   stats.printCSVHeader(out);
-  cerr << "\n";
 }
 
 void KdTreeAccel::printTimingStatsCSV(std::ostream &out) {
-  stats.printCSV(out);
-  cerr << "\n";
-
+  stats.printCSV(out, m_options.timeInTicks);
 }
@@ -44,7 +44,7 @@
 #include <ostream>
 
 #include "KdTreeAccel_base.h"
-#include "TriangleMesh.h"
+#include "GeometryView.h"
 #include "BoundingBox.h"
 #include "common.h"
 #include "Stats.h"
@@ -55,10 +55,9 @@ typedef std::vector<bool> mem_type;
 
 class KdTreeAccel : public KdTreeAccel_base {
 public:
-  KdTreeAccel(TriangleMesh * _mesh, unsigned int numThreads,
-              unsigned int max_depth);
+  KdTreeAccel(const GeometryView &geometry, const BuildOptions &options);
   
-  ~KdTreeAccel() { }
+  ~KdTreeAccel() { delete m_root; }
 
   // Mandatory functions
   void build();
@@ -71,9 +70,30 @@ public:
   KdTreeNode * buildTree_boxEdges(const BoundingBox& nodeExtent,
                                   vv_BoxEdge& boxEdgeList,
                                   int maxDepth);
+
+  // a node for the given level; a LazyKdTreeNode at BuildOptions::lazyDepth
+  KdTreeNode *allocNode(unsigned int level);
+
+  // (see KdTreeAccel_rebuild.cpp)
+  bool rebuild(const std::vector<int> &changed,
+               const std::vector<BoundingBox> &bounds, float threshold);
+  // builds node's subtree again from the kept edges of its triangles
+  void rebuildSubtree(KdTreeNode *node, unsigned int depth);
 public:
   Stats stats;
 
+protected:
+  // builds the subtree of a LazyKdTreeNode serially on the calling thread;
+  // queries that reach other lazy nodes meanwhile build those in parallel
+  bool expandLazy(KdTreeNode *node);
+
+private:
+  // the whole mesh's box edges, sorted, kept for rebuild()
+  vv_BoxEdge m_edges;
+
+  // node takes over what subtree holds, in place of its own
+  void graft(KdTreeNode *node, KdTreeNode *subtree);
+
 };
 
 void impl_usage();
@@ -0,0 +1,283 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <tbb/task.h>
+#include <tbb/tick_count.h>
+
+#include "KdTreeAccel.h"
+#include "RebuildSubtree_task.h"
+
+using namespace std;
+using namespace tbb;
+
+namespace {
+
+// a changed triangle: where it was and where it is now
+struct MovedTriangle {
+  int triangle;
+  BoundingBox from, to;
+};
+
+// SAH cost of a subtree (not normalized, see TreeQuality) before and after
+// the moved triangles were patched in
+struct SubtreeCost {
+  double before, after;
+};
+typedef map<const KdTreeNode*, SubtreeCost> CostMap;
+
+inline double surfaceArea(const BoundingBox &b) {
+  double dx = b.max[0] - b.min[0];
+  double dy = b.max[1] - b.min[1];
+  double dz = b.max[2] - b.min[2];
+  return 2.0*(dx*dy + dy*dz + dz*dx);
+}
+
+// closed intervals: a triangle with a bound on a split plane can be on
+// either side of it
+inline bool overlaps(const BoundingBox &a, const BoundingBox &b) {
+  for (int i=0;i<3;i++) {
+    if (a.max[i] < b.min[i] || b.max[i] < a.min[i]) return false;
+  }
+  return true;
+}
+
+double subtreeCost(const KdTreeNode *node, const SAH &sah) {
+  if (!node) return 0.0;
+  if (!node->splitEdge) {
+    size_t n = node->triangleIndices ? node->triangleIndices->size() : 0;
+    return sah.m_Ci * n * surfaceArea(node->extent);
+  }
+  return sah.m_Ct * surfaceArea(node->extent)
+    + subtreeCost(node->left, sah) + subtreeCost(node->right, sah);
+}
+
+// Takes the moved triangles out of the leaves under node and adds them to
+// the leaves their new bounds overlap; which are the ones that may concern
+// node. Records the cost of every node on the way. (The nested builder
+// always makes both children of a node.)
+SubtreeCost patch(KdTreeNode *node, const vector<MovedTriangle> &moved,
+                  const vector<uint> &which, const vector<int> &slot,
+                  const SAH &sah, CostMap &costs) {
+  vector<uint> here;
+  for (uint i=0;i<which.size();i++) {
+    const MovedTriangle &m = moved[which[i]];
+    if (overlaps(node->extent, m.from) || overlaps(node->extent, m.to)) {
+      here.push_back(which[i]);
+    }
+  }
+
+  SubtreeCost cost;
+  if (here.empty()) {
+    cost.before = cost.after = subtreeCost(node, sah);
+    return cost;
+  }
+
+  double area = surfaceArea(node->extent);
+  if (!node->splitEdge) {
+    if (!node->triangleIndices) node->triangleIndices = new vector<int>();
+    vector<int> &triangles = *node->triangleIndices;
+    cost.before = sah.m_Ci * triangles.size() * area;
+
+    size_t kept = 0;
+    for (size_t i=0;i<triangles.size();i++) {
+      if (slot[triangles[i]] < 0) triangles[kept++] = triangles[i];
+    }
+    triangles.resize(kept);
+    for (uint i=0;i<here.size();i++) {
+      if (overlaps(node->extent, moved[here[i]].to)) {
+        triangles.push_back(moved[here[i]].triangle);
+      }
+    }
+    cost.after = sah.m_Ci * triangles.size() * area;
+  } else {
+    SubtreeCost left = { 0.0, 0.0 }, right = { 0.0, 0.0 };
+    if (node->left) left = patch(node->left, moved, here, slot, sah, costs);
+    if (node->right) right = patch(node->right, moved, here, slot, sah, costs);
+    cost.before = sah.m_Ct * area + left.before + right.before;
+    cost.after = sah.m_Ct * area + left.after + right.after;
+  }
+  costs[node] = cost;
+  return cost;
+}
+
+// the topmost patched nodes whose cost grew past the threshold
+void pickRebuilds(KdTreeNode *node, uint depth, const CostMap &costs,
+                  float threshold, vector<pair<KdTreeNode*, uint> > &roots) {
+  CostMap::const_iterator I = costs.find(node);
+  if (I == costs.end()) return;
+  if (I->second.after > I->second.before * (1.0 + threshold)) {
+    roots.push_back(make_pair(node, depth));
+    return;
+  }
+  if (node->left) pickRebuilds(node->left, depth+1, costs, threshold, roots);
+  if (node->right) pickRebuilds(node->right, depth+1, costs, threshold, roots);
+}
+
+void markTriangles(const KdTreeNode *node, vector<char> &member) {
+  if (!node) return;
+  if (!node->splitEdge) {
+    if (!node->triangleIndices) return;
+    for (size_t i=0;i<node->triangleIndices->size();i++) {
+      member[(*node->triangleIndices)[i]] = 1;
+    }
+    return;
+  }
+  markTriangles(node->left, member);
+  markTriangles(node->right, member);
+}
+
+} // namespace
+
+bool KdTreeAccel::rebuild(const vector<int> &changed,
+                          const vector<BoundingBox> &bounds,
+                          float threshold) {
+  if (!m_root || m_edges.empty() || changed.size() != bounds.size()) {
+    return false;
+  }
+
+  int n = m_edges[0].size()/2;
+  vector<int> slot(n, -1); // triangle -> its entry in moved
+  vector<MovedTriangle> moved(changed.size());
+  for (uint k=0;k<changed.size();k++) {
+    if (changed[k] < 0 || changed[k] >= n || slot[changed[k]] >= 0) {
+      return false;
+    }
+    slot[changed[k]] = k;
+    moved[k].triangle = changed[k];
+    moved[k].to = bounds[k];
+  }
+  m_subtreesRebuilt = 0;
+  // --budget-ms covers each rebuild on its own
+  m_budgetStart = tick_count::now();
+
+  // the moved triangles' old edges say where they were; their new ones
+  // merge into the kept order of all the others, which needs no sort
+  for (uint axis=0;axis<3;axis++) {
+    v_BoxEdge &edges = m_edges[axis];
+    v_BoxEdge kept, fresh;
+    kept.reserve(edges.size());
+    fresh.reserve(2*moved.size());
+    for (v_BoxEdge::const_iterator I=edges.begin(), E=edges.end();
+         I!=E; I++) {
+      int k = slot[I->triangleIndex];
+      if (k < 0) {
+        kept.push_back(*I);
+      } else if (I->edgeType == START) {
+        moved[k].from.min[axis] = I->t;
+      } else {
+        moved[k].from.max[axis] = I->t;
+      }
+    }
+    for (uint k=0;k<moved.size();k++) {
+      fresh.push_back(BoxEdge(moved[k].to.min[axis], moved[k].triangle,
+                              START, axis));
+      fresh.push_back(BoxEdge(moved[k].to.max[axis], moved[k].triangle,
+                              END, axis));
+    }
+    sort(fresh.begin(), fresh.end());
+    merge(kept.begin(), kept.end(), fresh.begin(), fresh.end(),
+          edges.begin());
+  }
+
+  // a triangle moved out of the root's extent changes every node's:
+  // the whole tree is built again
+  vector<pair<KdTreeNode*, uint> > roots;
+  BoundingBox extent = m_root->extent;
+  for (uint k=0;k<moved.size();k++) {
+    for (uint i=0;i<3;i++) {
+      extent.min[i] = min(extent.min[i], moved[k].to.min[i]);
+      extent.max[i] = max(extent.max[i], moved[k].to.max[i]);
+    }
+  }
+  bool grown = false;
+  for (uint i=0;i<3;i++) {
+    grown = grown || extent.min[i] != m_root->extent.min[i]
+      || extent.max[i] != m_root->extent.max[i];
+  }
+
+  if (grown) {
+    m_root->extent = extent;
+    roots.push_back(make_pair(m_root, 0u));
+  } else {
+    vector<uint> all(moved.size());
+    for (uint k=0;k<moved.size();k++) all[k] = k;
+    CostMap costs;
+    patch(m_root, moved, all, slot, sah, costs);
+    pickRebuilds(m_root, 0, costs, threshold, roots);
+  }
+
+  if (!roots.empty()) {
+    task &pRootTask = *new(task::allocate_root()) empty_task;
+    task_list tList;
+    for (uint i=0;i<roots.size();i++) {
+      tList.push_back(*new(pRootTask.allocate_child())
+                      RebuildSubtree_task(this, roots[i].first,
+                                          roots[i].second));
+    }
+    pRootTask.set_ref_count(roots.size()+1);
+    pRootTask.spawn_and_wait_for_all(tList);
+    pRootTask.destroy(pRootTask);
+  }
+  m_subtreesRebuilt = roots.size();
+  return true;
+}
+
+void KdTreeAccel::rebuildSubtree(KdTreeNode *node, unsigned int depth) {
+  // the node's triangles, in the order kept from the build
+  vv_BoxEdge boxEdgeList(3);
+  if (node == m_root) {
+    boxEdgeList = m_edges;
+  } else {
+    vector<char> member(m_edges[0].size()/2, 0);
+    markTriangles(node, member);
+    for (uint axis=0;axis<3;axis++) {
+      for (v_BoxEdge::const_iterator I=m_edges[axis].begin(),
+             E=m_edges[axis].end(); I!=E; I++) {
+        if (member[I->triangleIndex]) boxEdgeList[axis].push_back(*I);
+      }
+    }
+  }
+
+  graft(node, buildTree_boxEdges(node->extent, boxEdgeList,
+                                 m_maxDepth - depth));
+}
@@ -83,7 +83,7 @@ task* ParKdTreeNested_np_task::execute() {
       return NULL;
     }
 
-    vector<char> membership(mesh->triangleList.size(), 0);
+    vector<char> membership(geometry->numTriangles(), 0);
 
     vv_BoxEdge left(3), right(3);
     unsigned int left_s = 0, right_s = 0;
@@ -125,7 +125,7 @@ task* ParKdTreeNested_np_task::execute() {
     // newNode->isLeaf = false;
     // newNode->splitAxis = bestEdge->axis;
     // newNode->splitValue = bestEdge->t;
-    newNode->splitEdge = bestEdge;
+    newNode->splitEdge = new BoxEdge(*bestEdge);
 
     // dynamic load-balancing
     unsigned int threshold = 0;
@@ -149,13 +149,13 @@ task* ParKdTreeNested_np_task::execute() {
       // left task
       if (forkLeft) {
           KdTreeNode *newLeftNode = new KdTreeNode();
-          tlist.push_back(*new(allocate_child()) ParKdTreeNested_np_task(mesh, leftNodeExtent, left, maxDepth-1, newLeftNode, accel, numThreads, level+1));
+          tlist.push_back(*new(allocate_child()) ParKdTreeNested_np_task(geometry, leftNodeExtent, left, maxDepth-1, newLeftNode, accel, numThreads, level+1));
           newNode->left = newLeftNode;
       }
       // right task
       if (forkRight) {
           KdTreeNode *newRightNode = new KdTreeNode();
-          tlist.push_back(*new(allocate_child()) ParKdTreeNested_np_task(mesh, rightNodeExtent, right, maxDepth-1, newRightNode, accel, numThreads, level+1));
+          tlist.push_back(*new(allocate_child()) ParKdTreeNested_np_task(geometry, rightNodeExtent, right, maxDepth-1, newRightNode, accel, numThreads, level+1));
           newNode->right = newRightNode;
       }
       spawn(tlist);
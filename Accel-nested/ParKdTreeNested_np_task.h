@@ -42,19 +42,19 @@
 
 #include "ParKdTreeNested_task.h"
 #include "KdTreeAccel.h"
-#include "TriangleMesh.h"
+#include "GeometryView.h"
 #include "BoundingBox.h"
 
 // node-level parallelism only
 class ParKdTreeNested_np_task : public ParKdTreeNested_task {
 
 public:
-  ParKdTreeNested_np_task(const TriangleMesh *mesh, BoundingBox& nodeExtent,
-                          vv_BoxEdge& boxEdgeList,
+  ParKdTreeNested_np_task(const GeometryView *geometry,
+                          BoundingBox& nodeExtent, vv_BoxEdge& boxEdgeList,
                           int maxDepth, KdTreeNode* newNode, 
                           KdTreeAccel* accel, unsigned int numThreads, 
                           unsigned int level) :
-    ParKdTreeNested_task(mesh, nodeExtent, boxEdgeList, maxDepth, 
+    ParKdTreeNested_task(geometry, nodeExtent, boxEdgeList, maxDepth, 
                          newNode, accel, numThreads, level) {}
 
   task *execute();
@@ -42,6 +42,7 @@
 #include <tbb/task.h>
 
 #include "ParKdTreeNested_task.h"
+#include "LazyKdTreeNode.h"
 #include "ClassifyTriangles_task.h"
 #include "MergeMembership_task.h"
 #include "FilterGeom_presplit_task.h"
@@ -51,7 +52,8 @@
 //#include "common.h"
 #include "timers.h"
 #include "BoundingBox.h"
-#include "options.h"
+#include "Tracer.h"
+#include "PerfCounters.h"
 
 using namespace std;
 using namespace tbb;
@@ -65,11 +67,30 @@ task* ParKdTreeNested_task::execute() {
       accel->stats.build_start);
   }
 
+  // cancelled: leave the node empty, the build throws the tree away
+  if (accel->checkCancel()) {
+    return NULL;
+  }
+
   unsigned int num_triangles = boxEdgeList[0].size()/2;
+  long nodeId = (long)newNode; // for tracing
+  // counters cover the same (root-level) phases as Stats
+  PerfCounters *perf = (level == 0) ? accel->perfCounters() : NULL;
 
-  // make this node a leaf (no triangle or reached the max depth)
-  if (maxDepth == 0 || num_triangles == 0) {
+  // at BuildOptions::lazyDepth: keep the triangles, the subtree gets built
+  // when a query first reaches it (KdTreeAccel::expandLazy)
+  if (newNode->lazy) {
     makeLeaf(newNode, nodeExtent, boxEdgeList);
+    static_cast<LazyKdTreeNode*>(newNode)->maxDepth = maxDepth;
+    accel->reportProgress(level, 1, 0);
+    return NULL;
+  }
+
+  // make this node a leaf (no triangle, reached the max depth or out of
+  // --budget-ms time)
+  if (maxDepth == 0 || num_triangles == 0 || accel->budgetLeftMs() <= 0) {
+    makeLeaf(newNode, nodeExtent, boxEdgeList);
+    accel->reportProgress(level, 1, 0);
     return NULL;
   } else {
     const BoxEdge *bestEdge = NULL;
@@ -79,6 +100,7 @@ task* ParKdTreeNested_task::execute() {
         accel->stats.findBestPlane_usec[0],
         accel->stats.findBestPlane[0]);
     }
+    PerfScope findBestPlanePerf(perf, PERF_FINDBESTPLANE);
 
     // 1. PRESCAN + FINAL-SAH *********************************************
     bestEdge = ll_nAnB_SAH(boxEdgeList, nodeExtent, accel, num_triangles);
@@ -86,9 +108,11 @@ task* ParKdTreeNested_task::execute() {
     // make this node a leaf node, if worthwhile splitting plane was not found
     if (!bestEdge) {
       makeLeaf(newNode, nodeExtent, boxEdgeList);
+      accel->reportProgress(level, 1, 6*num_triangles);
       return NULL;
     }
   
+    findBestPlanePerf.end();
     if (level == 0) {
       RECORD_TIME(
         accel->stats.findBestPlane_usec[1],
@@ -100,18 +124,21 @@ task* ParKdTreeNested_task::execute() {
         accel->stats.classifyTriangles_usec[0],
         accel->stats.classifyTriangles[0]);
     }
+    PerfScope classifyPerf(perf, PERF_CLASSIFYTRIANGLES);
 
     // 2. MEM *************************************************************
+    TraceScope classifyTrace(accel->tracer(), "classify", level, nodeId, 
+                             boxEdgeList[bestEdge->axis].size());
     unsigned int left_child = 0, right_child = 0, straddling = 0;
     unsigned int bestSplitAxis = bestEdge->axis;
-    mem_type membership(mesh->triangleList.size()*2, 0);
+    mem_type membership(geometry->numTriangles()*2, 0);
 
     v_BoxEdge::const_iterator I = boxEdgeList[bestEdge->axis].begin();
     v_BoxEdge::const_iterator E = boxEdgeList[bestEdge->axis].end();
 
 /* 
     // parallel MEM
-    mem_type membership(mesh->triangleList.size()*2, 0);
+    mem_type membership(geometry->numTriangles()*2, 0);
     ll_mem(boxEdgeList[bestEdge->axis], membership, index_best, numThreads);
 */
     for (; (&(*I)) != bestEdge; I++) {
@@ -131,6 +158,9 @@ task* ParKdTreeNested_task::execute() {
       }
     }
 
+    classifyTrace.end();
+
+    classifyPerf.end();
     if (level == 0) {
       RECORD_TIME(
         accel->stats.classifyTriangles_usec[1],
@@ -142,17 +172,23 @@ task* ParKdTreeNested_task::execute() {
         accel->stats.filterGeom_usec[0],
         accel->stats.filterGeom[0]);
     }
+    PerfScope filterGeomPerf(perf, PERF_FILTERGEOM);
 
     // 3. SPLIT ***********************************************************
 
     vv_BoxEdge left(3), right(3);
-    if (numThreads == 1 && !g_superfluous_prescans) {
-      sq_split(boxEdgeList, membership, left, right);
-    } else {
-      ll_split(boxEdgeList, membership, left, right, numThreads);
+    {
+      TraceScope trace(accel->tracer(), "filter", level, nodeId, 
+                       3*boxEdgeList[0].size());
+      if (numThreads == 1 && !accel->options().superfluousPrescans) {
+        sq_split(boxEdgeList, membership, left, right);
+      } else {
+        ll_split(boxEdgeList, membership, left, right, numThreads);
+      }
     }
 
     // ********************************************************************
+    filterGeomPerf.end();
     if (level == 0) {
       RECORD_TIME(
         accel->stats.filterGeom_usec[1],
@@ -174,10 +210,13 @@ task* ParKdTreeNested_task::execute() {
         accel->stats.recursiveTaskCreation_usec[0],
         accel->stats.recursiveTaskCreation[0]);
     }
+    PerfScope taskCreationPerf(perf, PERF_TASKCREATION);
 
     // recurse...
     newNode->extent = nodeExtent;
-    newNode->splitEdge = bestEdge;
+    // bestEdge points into boxEdgeList, which the parent task owns
+    newNode->splitEdge = new BoxEdge(*bestEdge);
+    accel->reportProgress(level, 1, 6*num_triangles);
 
     // dynamic load-balancing
     unsigned int threshold = 0;
@@ -196,13 +235,14 @@ task* ParKdTreeNested_task::execute() {
     }
 
     if (ref > 0) {
+      TraceScope spawnTrace(accel->tracer(), "spawn", level, nodeId);
       set_ref_count(ref+1);
 
       task_list tlist;
       // fork left task
       if (forkLeft) {
-        KdTreeNode *newLeftNode = new KdTreeNode();
-        tlist.push_back(*new(allocate_child()) ParKdTreeNested_task(mesh, leftNodeExtent,
+        KdTreeNode *newLeftNode = accel->allocNode(level+1);
+        tlist.push_back(*new(allocate_child()) ParKdTreeNested_task(geometry, leftNodeExtent,
                                                                     left, maxDepth-1, newLeftNode,
                                                                     accel, numThreads, level+1));
         
@@ -211,14 +251,15 @@ task* ParKdTreeNested_task::execute() {
       
       // fork right task
       if (forkRight) {
-        KdTreeNode *newRightNode = new KdTreeNode();
-        tlist.push_back(*new(allocate_child()) ParKdTreeNested_task(mesh, rightNodeExtent,
+        KdTreeNode *newRightNode = accel->allocNode(level+1);
+        tlist.push_back(*new(allocate_child()) ParKdTreeNested_task(geometry, rightNodeExtent,
                                                                     right, maxDepth-1, newRightNode,
                                                                     accel, numThreads, level+1));
         newNode->right = newRightNode;
       }
 
       spawn(tlist);
+      spawnTrace.end();
 
       // for non-forking ones, this task builds the rest of the subtrees
       if (!forkLeft) {
@@ -232,6 +273,7 @@ task* ParKdTreeNested_task::execute() {
       newNode->right = accel->buildTree_boxEdges(rightNodeExtent, right, maxDepth-1);
     }
 
+    taskCreationPerf.end();
     if (level == 0) {
       RECORD_TIME(
         accel->stats.recursiveTaskCreation_usec[1],
@@ -286,7 +328,7 @@ void ParKdTreeNested_task::ll_mem(v_BoxEdge& boxEdge,
   
   mem_type membership_local[numThreads];
   for (int i=0;i<numThreads-1;i++) {
-    membership_local[i].resize(mesh->triangleList.size()*2);
+    membership_local[i].resize(geometry->numTriangles()*2);
   } 
 
   // parallel membership update
@@ -306,7 +348,7 @@ void ParKdTreeNested_task::ll_mem(v_BoxEdge& boxEdge,
 
   // parallel merge
   idx = 0;
-  incr = (mesh->triangleList.size() * 2) / numThreads;
+  incr = (geometry->numTriangles() * 2) / numThreads;
   for (size_t i=0;i<numThreads-1;i++) {
     tList.push_back(*new(pRootTask.allocate_child())
                     MergeMembership_task(membership_local, membership, idx, 
@@ -315,7 +357,7 @@ void ParKdTreeNested_task::ll_mem(v_BoxEdge& boxEdge,
   }
   tList.push_back(*new(pRootTask.allocate_child())
                   MergeMembership_task(membership_local, membership, idx, 
-                                       mesh->triangleList.size()*2, numThreads));
+                                       geometry->numTriangles()*2, numThreads));
   
   pRootTask.set_ref_count((numThreads)+1);
   pRootTask.spawn_and_wait_for_all(tList);
@@ -406,6 +448,8 @@ const BoxEdge* ParKdTreeNested_task::ll_nAnB_SAH(const vv_BoxEdge &boxEdgeList,
   size_t incr = boxEdgeList[0].size() / numThreads;
 
   // pre-scan
+  TraceScope prescanTrace(accel->tracer(), "prescan", level, (long)newNode, 
+                          3*boxEdgeList[0].size());
   if (true || numThreads > 1) {
   for (size_t k=0;k<3;k++) {
     size_t idx = 0;
@@ -430,7 +474,11 @@ const BoxEdge* ParKdTreeNested_task::ll_nAnB_SAH(const vv_BoxEdge &boxEdgeList,
   }
   }
 
+  prescanTrace.end();
+
   // nAnB final scan + SAH
+  TraceScope finalScanTrace(accel->tracer(), "final scan", level, (long)newNode, 
+                            3*boxEdgeList[0].size());
   for (size_t k=0;k<3;k++) {
     size_t idx = 0;
     // for single thread?
@@ -454,6 +502,7 @@ const BoxEdge* ParKdTreeNested_task::ll_nAnB_SAH(const vv_BoxEdge &boxEdgeList,
 
   pRootTask.set_ref_count(numThreads*3+1);
   pRootTask.spawn_and_wait_for_all(tList);
+  finalScanTrace.end();
 
   // sequential scan for the global best SAH
   for (size_t k=0;k<3;k++) {
@@ -43,13 +43,13 @@
 #include <tbb/task.h>
 
 #include "KdTreeAccel.h"
-#include "TriangleMesh.h"
+#include "GeometryView.h"
 #include "BoundingBox.h"
 
 class ParKdTreeNested_task : public tbb::task {
 
 public:
-  const TriangleMesh *mesh;
+  const GeometryView *geometry;
   BoundingBox& nodeExtent;
   vv_BoxEdge& boxEdgeList;
   int maxDepth;
@@ -60,11 +60,11 @@ public:
   int nA, nB;
 
   // constructor
-  ParKdTreeNested_task(const TriangleMesh *mesh_, BoundingBox& nodeExtent_,
-                       vv_BoxEdge& boxEdgeList,
+  ParKdTreeNested_task(const GeometryView *geometry_,
+                       BoundingBox& nodeExtent_, vv_BoxEdge& boxEdgeList,
                        int maxDepth_, KdTreeNode *newNode_, KdTreeAccel *accel,
                        unsigned int numThreads, unsigned int level) :
-    mesh(mesh_), nodeExtent(nodeExtent_),  boxEdgeList(boxEdgeList),
+    geometry(geometry_), nodeExtent(nodeExtent_),  boxEdgeList(boxEdgeList),
     maxDepth(maxDepth_), newNode(newNode_), accel(accel), numThreads(numThreads),
     level(level) {}
 
@@ -41,15 +41,22 @@
 #include <cstring>
 
 #include "Stats.h"
-#include "options.h"
 
 using namespace std;
 
-Stats::Stats(uint maxDepth) : Stats_base(maxDepth) {
+Stats::Stats(uint maxDepth)
+  : Stats_base(maxDepth), start(0), init_CreateEdges(0), init_sort(0),
+    init_finish(0), build_start(0), build_finish(0), start_usec(0),
+    init_CreateEdges_usec(0), init_sort_usec(0), init_finish_usec(0),
+    build_start_usec(0), build_finish_usec(0) {
   memset(findBestPlane, 0, sizeof(uint64)*2);
   memset(classifyTriangles, 0, sizeof(uint64)*2);
   memset(filterGeom, 0, sizeof(uint64)*2);
   memset(recursiveTaskCreation, 0, sizeof(uint64)*2);
+  memset(findBestPlane_usec, 0, sizeof(long int)*2);
+  memset(classifyTriangles_usec, 0, sizeof(long int)*2);
+  memset(filterGeom_usec, 0, sizeof(long int)*2);
+  memset(recursiveTaskCreation_usec, 0, sizeof(long int)*2);
 }
 
 Stats::~Stats() { }
@@ -73,8 +80,8 @@ void Stats::printCSVHeader(std::ostream &out) {
 
 }
 
-void Stats::printCSV(std::ostream &out) {
-  if (g_time_in_ticks) {
+void Stats::printCSV(std::ostream &out, bool inTicks) {
+  if (inTicks) {
     cerr << "," << start
          << "," << init_CreateEdges
          << "," << init_sort
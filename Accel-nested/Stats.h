@@ -52,7 +52,7 @@ public:
 
   // Mandatory functions
   void printCSVHeader(std::ostream &out);
-  void printCSV(std::ostream &out);
+  void printCSV(std::ostream &out, bool inTicks);
 
   uint64 start, init_CreateEdges, init_sort;
   uint64 init_finish, build_start, build_finish;
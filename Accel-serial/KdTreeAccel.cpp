@@ -44,23 +44,16 @@
 
 #include "KdTreeAccel.h"
 #include "timers.h"
-#include "TriangleMesh.h"
+#include "GeometryView.h"
 #include "BoundingBox.h"
 
 using namespace std;
 
-int grain_size = -1;
-bool verbose_level0 = false;
-
-#define level(code) if (verbose_level0 && level==0) { code ; }
-
-string stats[6];
-
-KdTreeAccel::KdTreeAccel(TriangleMesh * mesh, unsigned int numThreads,
-                         unsigned int maxDepth) 
-  : KdTreeAccel_base(mesh, numThreads, maxDepth) {
+KdTreeAccel::KdTreeAccel(const GeometryView &geometry,
+                         const BuildOptions &options)
+  : KdTreeAccel_base(geometry, options) {
   // this is a serial version (numThread > 1 is an error)
-  if (numThreads > 1) {
+  if (options.numThreads > 1) {
     cerr << "Accel-serial is a serial version; n=1 only is allowed." << endl;
     cerr << " Will run with 1 thread." << endl;
   }
@@ -71,11 +64,10 @@ string KdTreeAccel::impl_string() {
 }
 
 void KdTreeAccel::build() {
+  beginBuild();
 
-  // root node
-  m_root = new KdTreeNode();
-  // bounding box for the root node
-  BoundingBox &nodeExtent = *new BoundingBox(m_mesh->boundingBox);
+  // bounding box for the root node, grown as the edges are created
+  BoundingBox nodeExtent;
 
   // list of boxedges
   vv_BoxEdge boxEdgeList(3);
@@ -83,7 +75,7 @@ void KdTreeAccel::build() {
   // construct list of triangle indices (0...n-1),
   // where n is number of triangles
   vector<int, tbb::scalable_allocator<int> > triangleIndices;
-  for (int i = 0; i < (int)(m_mesh->triangleList.size()); i++) {
+  for (int i = 0; i < (int)(m_geometry.numTriangles()); i++) {
       triangleIndices.push_back(i);
   }
 
@@ -95,8 +87,12 @@ void KdTreeAccel::build() {
   // init boxedge lists
   for (unsigned int i = 0; i < 3; i++) {
     for (unsigned int j = 0; j < n; j++) {
-      boxEdgeList[i][j*2] = BoxEdge(m_mesh->triangleList[triangleIndices[j]].bound.min[i], triangleIndices[j], START, i);
-      boxEdgeList[i][j*2+1] = BoxEdge(m_mesh->triangleList[triangleIndices[j]].bound.max[i], triangleIndices[j], END, i);
+      float lo, hi;
+      m_geometry.bounds(i, triangleIndices[j], lo, hi);
+      if (lo < nodeExtent.min[i]) nodeExtent.min[i] = lo;
+      if (hi > nodeExtent.max[i]) nodeExtent.max[i] = hi;
+      boxEdgeList[i][j*2] = BoxEdge(lo, triangleIndices[j], START, i);
+      boxEdgeList[i][j*2+1] = BoxEdge(hi, triangleIndices[j], END, i);
     }
   }
 
@@ -107,14 +103,25 @@ void KdTreeAccel::build() {
 
   // serial tree construction using box-edges
   m_root = buildTree_boxEdges(nodeExtent, boxEdgeList, m_maxDepth);
+
+  if (cancelled()) {
+    delete m_root;
+    discardTree();
+  }
 }
 
 KdTreeNode *KdTreeAccel::buildTree_boxEdges(const BoundingBox& nodeExtent,
                                                 vv_BoxEdge& boxEdgeList,
                                                 int maxDepth) {
   KdTreeNode * newNode = new KdTreeNode();
+  // cancelled: an empty node, the tree goes anyway
+  if (checkCancel()) {
+    return newNode;
+  }
+  uint level = m_maxDepth - maxDepth;
   unsigned int triangles = boxEdgeList[0].size()/2;
   if (maxDepth == 0 || triangles == 0) {
+    reportProgress(level, 1, 0);
     newNode->left = NULL;
     newNode->right = NULL;
     newNode->extent = nodeExtent;
@@ -153,6 +160,8 @@ KdTreeNode *KdTreeAccel::buildTree_boxEdges(const BoundingBox& nodeExtent,
       }
     }
 
+    reportProgress(level, 1, 6*triangles);
+
     // not worth splitting
     if (!bestEdge) {
       newNode->right = NULL;
@@ -169,7 +178,7 @@ KdTreeNode *KdTreeAccel::buildTree_boxEdges(const BoundingBox& nodeExtent,
       return newNode;
     }
 
-    vector<char> membership(m_mesh->triangleList.size(), 0);
+    vector<char> membership(m_geometry.numTriangles(), 0);
     vv_BoxEdge left(3), right(3);
     unsigned int left_s = 0, right_s = 0;
     v_BoxEdge::const_iterator I = boxEdgeList[bestEdge->axis].begin(),
@@ -208,9 +217,10 @@ KdTreeNode *KdTreeAccel::buildTree_boxEdges(const BoundingBox& nodeExtent,
 
     // recurse..
     newNode->extent = nodeExtent;
-    newNode->splitEdge = bestEdge;
+    // bestEdge lives in boxEdgeList, which goes away with this call
+    newNode->splitEdge = new BoxEdge(*bestEdge);
 
-    //    if (ver_splitedge) {
+    //    if (m_options.printSplitEdges) {
 //    if (true) {
 //      cerr << 8-maxDepth << " "
 //           << setprecision(3) << fixed << " [@ " 
@@ -237,10 +247,7 @@ void KdTreeAccel::printTimingStats(ostream &out) {
 }
 
 void KdTreeAccel::printTimingStatsCSVHeader(std::ostream &out) {
-  cerr << "\n";
 }
 
 void KdTreeAccel::printTimingStatsCSV(std::ostream &out) {
-  cerr << "\n";
-
 }
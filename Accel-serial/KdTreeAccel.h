@@ -44,21 +44,20 @@
 #include <ostream>
 
 #include "KdTreeAccel_base.h"
-#include "TriangleMesh.h"
+#include "GeometryView.h"
 #include "BoundingBox.h"
 #include "common.h"
 
 class KdTreeAccel : public KdTreeAccel_base {
 public:
-    KdTreeAccel(TriangleMesh * _mesh, unsigned int numThreads,
-                unsigned int max_depth);
+    KdTreeAccel(const GeometryView &geometry, const BuildOptions &options);
   
   /* Will take this out later - BC [2010-03-27 Sat 00:49]
     KdTreeAccel(TriangleMesh *mesh, BoundingBox &nodeExtent,
                 std::vector<int> trianglesIndices, unsigned int maxDepth);
   */
 
-    ~KdTreeAccel() { }
+    ~KdTreeAccel() { delete m_root; }
 
   // Mandatory functions
   void build();
@@ -53,6 +53,6 @@ void Stats::printCSVHeader(std::ostream &out) {
 
 }
 
-void Stats::printCSV(std::ostream &out) {
+void Stats::printCSV(std::ostream &out, bool inTicks) {
 
 }
@@ -52,7 +52,7 @@ public:
 
   // Mandatory functions
   void printCSVHeader(std::ostream &out);
-  void printCSV(std::ostream &out);
+  void printCSV(std::ostream &out, bool inTicks);
 };
 
 #endif // _STATS_H_
@@ -0,0 +1,109 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _BUILDOPTIONS_H_
+#define _BUILDOPTIONS_H_
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "SAH.h"
+#include "Numa.h"
+
+// Per-build parameters. These used to be process-wide flags set by the
+// parkd front end; keeping them with the accel lets several builds with
+// different settings share one process.
+struct BuildOptions {
+  BuildOptions()
+    : numThreads(1), maxDepth(8),
+      Ct(Ct_DEFAULT), Ci(Ci_DEFAULT), emptyBonus(emptyBonus_DEFAULT),
+      superfluousPrescans(false), timeInTicks(false), verbose(false),
+      printSplitEdges(false), numaPolicy(NUMA_DEFAULT),
+      deterministic(false), budgetMs(0), lazyDepth(0), incremental(false),
+      compactEvery(0), segmented(false) { }
+
+  uint numThreads;          // work is split into this many chunks per phase
+  uint maxDepth;
+
+  // SAH parameters
+  float Ct, Ci, emptyBonus;
+
+  bool superfluousPrescans; // run the prescans even with one thread
+  bool timeInTicks;         // report timings in CPU ticks, not microseconds
+  bool verbose;
+  bool printSplitEdges;     // dump the chosen split of every node to cerr
+
+  NumaPolicy numaPolicy;    // placement of the big per-build arrays
+
+  // same tree, leaf contents in the same order, for any thread count
+  bool deterministic;
+
+  // depths below maxDepth to capture the tree at along the way (see
+  // KdTreeAccel_base::snapshots(); in-place builders only)
+  std::vector<uint> snapshotDepths;
+
+  // stop splitting this many milliseconds into build() and make leaves of
+  // what is left (0: no limit; in-place and nested builders only)
+  uint budgetMs;
+
+  // directory for files holding the big edge arrays, which then need not
+  // fit in RAM (empty: in memory; in-place builders only)
+  std::string outOfCoreDir;
+
+  // leave the nodes at this depth unexpanded, with their triangles, until
+  // a query reaches them (0: build the whole tree; nested builder only)
+  uint lazyDepth;
+
+  // keep the sorted box edges after the build, for
+  // KdTreeAccel_base::rebuild() (nested builder only)
+  bool incremental;
+
+  // every this many levels, drop the triangles that are only in leaves
+  // from the arrays the level sweeps visit (0: never; in-place builders
+  // with more than one thread only)
+  uint compactEvery;
+
+  // between levels, regroup the edges by live node so that each node's
+  // sweep is contiguous (SoA builder with more than one thread only;
+  // compactEvery does not apply then)
+  bool segmented;
+};
+
+#endif // _BUILDOPTIONS_H_
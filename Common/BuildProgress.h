@@ -0,0 +1,78 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _BUILDPROGRESS_H_
+#define _BUILDPROGRESS_H_
+
+#include <cstddef>
+
+#include <tbb/atomic.h>
+
+#include "common.h"
+
+// Asks a running build to stop (KdTreeAccel_base::setCancelToken). Any
+// thread may cancel(); the builder checks at its phase boundaries
+// (in-place) or per node (nested, serial), drops everything it allocated
+// and returns early, with KdTreeAccel_base::cancelled() set and no tree.
+class CancelToken {
+public:
+  CancelToken() { m_cancelled = false; }
+
+  void cancel() { m_cancelled = true; }
+  void reset() { m_cancelled = false; }
+  bool cancelled() const { return m_cancelled; }
+
+private:
+  tbb::atomic<bool> m_cancelled;
+};
+
+// Told how far a build has got (KdTreeAccel_base::setProgress). The counts
+// are running totals for the build: nodes decided (split or made a leaf)
+// and box edges swept looking for splits, with the level of the work just
+// finished. The nested builder reports from its worker threads, one call
+// per node, so an override has to be thread-safe and cheap.
+class BuildProgress {
+public:
+  virtual ~BuildProgress() { }
+
+  virtual void progress(uint level, uint nodesCompleted,
+                        size_t edgesProcessed) = 0;
+};
+
+#endif // _BUILDPROGRESS_H_
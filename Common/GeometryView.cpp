@@ -0,0 +1,90 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#include "GeometryView.h"
+
+GeometryView::GeometryView()
+  : m_numTriangles(0), m_hasBounds(false), m_boundsStride(0),
+    m_vertices(NULL), m_vertexStride(0), m_numVertices(0),
+    m_indices(NULL), m_indexStride(0), m_indexType(INDEX_UINT32) {
+  for (int axis=0;axis<3;axis++) {
+    m_min[axis] = m_max[axis] = NULL;
+  }
+}
+
+void GeometryView::setVertices(const void *data, size_t offset,
+                               size_t stride, uint count) {
+  m_vertices = (const char *)data + offset;
+  m_vertexStride = stride ? stride : 3*sizeof(float);
+  m_numVertices = count;
+}
+
+void GeometryView::setIndices(const void *data, size_t offset, size_t stride,
+                              IndexType type, uint triangleCount) {
+  size_t indexSize = (type == INDEX_UINT16) ?
+    sizeof(unsigned short) : sizeof(unsigned int);
+
+  m_indices = (const char *)data + offset;
+  m_indexStride = stride ? stride : 3*indexSize;
+  m_indexType = type;
+  if (!m_hasBounds) m_numTriangles = triangleCount;
+}
+
+void GeometryView::setBounds(const void *data, size_t minOffset,
+                             size_t maxOffset, size_t stride, uint count) {
+  m_hasBounds = true;
+  m_boundsStride = stride ? stride : 6*sizeof(float);
+  for (int axis=0;axis<3;axis++) {
+    m_min[axis] = (const char *)data + minOffset + axis*sizeof(float);
+    m_max[axis] = (const char *)data + maxOffset + axis*sizeof(float);
+  }
+  m_numTriangles = count;
+}
+
+void GeometryView::setBounds(const TriangleBounds &bounds) {
+  m_hasBounds = true;
+  m_boundsStride = sizeof(float);
+  m_numTriangles = bounds.size();
+  if (!m_numTriangles) return;
+
+  for (int axis=0;axis<3;axis++) {
+    m_min[axis] = (const char *)&bounds.min[axis][0];
+    m_max[axis] = (const char *)&bounds.max[axis][0];
+  }
+}
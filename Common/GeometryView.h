@@ -0,0 +1,123 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _GEOMETRYVIEW_H_
+#define _GEOMETRYVIEW_H_
+
+#include <stddef.h>
+#include <assert.h>
+
+#include "common.h"
+#include "TriangleBounds.h"
+
+// Non-owning description of the triangles to build over, so a host
+// application can hand its own buffers to the builders without copying them
+// into a TriangleMesh. The builders only need per-triangle bounds: these are
+// either given precomputed, or computed from indexed vertices while the
+// edges are created.
+//
+// All offsets and strides are in bytes; a stride of 0 means tightly packed.
+// Nothing is copied, so the buffers have to outlive every build that uses
+// the view.
+class GeometryView {
+public:
+  enum IndexType { INDEX_UINT16, INDEX_UINT32 };
+
+  GeometryView();
+
+  // vertex i's x, y, z are consecutive floats at data + offset + i*stride
+  void setVertices(const void *data, size_t offset, size_t stride,
+                   uint count);
+  // triangle i's three indices are consecutive at data + offset + i*stride
+  void setIndices(const void *data, size_t offset, size_t stride,
+                  IndexType type, uint triangleCount);
+
+  // Precomputed bounds, one record per triangle: the min and max corners
+  // are three consecutive floats each, at data + minOffset + i*stride and
+  // data + maxOffset + i*stride. Takes precedence over vertices/indices.
+  void setBounds(const void *data, size_t minOffset, size_t maxOffset,
+                 size_t stride, uint count);
+  // precomputed bounds, one array per axis (TriangleMesh's layout)
+  void setBounds(const TriangleBounds &bounds);
+
+  uint numTriangles() const { return m_numTriangles; }
+  bool hasBounds() const { return m_hasBounds; }
+
+  // extent of triangle i along axis
+  void bounds(uint axis, uint i, float &lo, float &hi) const {
+    if (m_hasBounds) {
+      lo = *(const float *)(m_min[axis] + i*m_boundsStride);
+      hi = *(const float *)(m_max[axis] + i*m_boundsStride);
+      return;
+    }
+
+    const char *tri = m_indices + i*m_indexStride;
+    uint v[3];
+    if (m_indexType == INDEX_UINT16) {
+      for (int k=0;k<3;k++) v[k] = ((const unsigned short *)tri)[k];
+    } else {
+      for (int k=0;k<3;k++) v[k] = ((const unsigned int *)tri)[k];
+    }
+    assert(v[0] < m_numVertices && v[1] < m_numVertices &&
+           v[2] < m_numVertices);
+
+    float c0 = ((const float *)(m_vertices + v[0]*m_vertexStride))[axis];
+    float c1 = ((const float *)(m_vertices + v[1]*m_vertexStride))[axis];
+    float c2 = ((const float *)(m_vertices + v[2]*m_vertexStride))[axis];
+    lo = c0 < c1 ? c0 : c1; if (c2 < lo) lo = c2;
+    hi = c0 > c1 ? c0 : c1; if (c2 > hi) hi = c2;
+  }
+
+private:
+  uint m_numTriangles;
+
+  bool m_hasBounds;
+  const char *m_min[3];
+  const char *m_max[3];
+  size_t m_boundsStride;
+
+  const char *m_vertices;
+  size_t m_vertexStride;
+  uint m_numVertices;
+  const char *m_indices;
+  size_t m_indexStride;
+  IndexType m_indexType;
+};
+
+#endif // _GEOMETRYVIEW_H_
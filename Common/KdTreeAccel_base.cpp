@@ -38,209 +38,222 @@
 */
 
 #include <fstream>
-#include <iterator>
-#include <map>
 #include <algorithm>
+#include <limits>
+
+#include <tbb/task.h>
 
 #include "KdTreeAccel_base.h"
+#include "PackTree_task.h"
 
 using namespace std;
 
-KdTreeAccel_base::KdTreeAccel_base(TriangleMesh *mesh, 
-                                   uint numThreads, uint maxDepth, 
-                                   float Ct, float Ci, float emptyBonus) 
-  : m_mesh(mesh), m_numThreads(numThreads), m_maxDepth(maxDepth),
-    sah(Ct, Ci, emptyBonus) {
+KdTreeAccel_base::KdTreeAccel_base(const GeometryView &geometry,
+                                   const BuildOptions &options)
+  : m_root(NULL), m_geometry(geometry), m_options(options),
+    m_numThreads(options.numThreads), m_maxDepth(options.maxDepth),
+    m_tracer(NULL), m_perf(NULL),
+    m_progress(NULL), m_cancel(NULL), m_subtreesRebuilt(0),
+    sah(options.Ct, options.Ci, options.emptyBonus) {
+  m_leavesUnpacked = false;
+  m_cancelled = false;
+  m_nodesCompleted = 0;
+  m_edgesProcessed = 0;
+  m_lazyBuilt = 0;
 
   // Sanity checks
-  assert(m_mesh);
   assert(m_numThreads > 0);
   assert(m_maxDepth > 0);
 }
 
-bool KdTreeAccel_base::writeToFile(char * filename) {
-  // fill in item list and node list by traversing the tree
-  vector<int> itemList;
-  vector<MantaKDTreeNode> nodeList;
-  nodeList.push_back(MantaKDTreeNode());
-  this->packNodesAndItems(this->m_root, 0, itemList, nodeList);
-  
+void KdTreeAccel_base::packTree(vector<int> &itemList,
+                                vector<MantaKDTreeNode> &nodeList) const {
+  if (packed()) {
+    itemList = m_packedItems;
+    nodeList = m_packedNodes;
+    return;
+  }
+
+  // subtree sizes bottom-up, then every subtree fills its own ranges
+  v_PackCount counts(1 << (PACKTREE_SPAWN_DEPTH+1));
+  tbb::task::spawn_root_and_wait(*new(tbb::task::allocate_root())
+                                 PackCount_task(m_root, 0, 1, counts));
+
+  itemList.clear();
+  nodeList.clear();
+  itemList.resize(counts[1].items);
+  nodeList.resize(1 + counts[1].nodes);
+  tbb::task::spawn_root_and_wait(*new(tbb::task::allocate_root())
+                                 PackFill_task(m_root, 0, 1, counts, 0, 1, 0,
+                                               &nodeList[0],
+                                               itemList.empty() ? NULL : &itemList[0]));
+}
+
+bool KdTreeAccel_base::writeToFile(const char * filename) {
+  vector<int> packedItems;
+  vector<MantaKDTreeNode> packedNodes;
+  if (!packed()) packTree(packedItems, packedNodes);
+  return writeToFile(filename, packed() ? m_packedItems : packedItems,
+                     packed() ? m_packedNodes : packedNodes);
+}
+
+bool KdTreeAccel_base::writeToFile(const char *filename,
+                                   const vector<int> &itemList,
+                                   const vector<MantaKDTreeNode> &nodeList) {
+  return writeToFile(filename, itemList.empty() ? NULL : &itemList[0],
+                     itemList.size(),
+                     nodeList.empty() ? NULL : &nodeList[0], nodeList.size());
+}
+
+bool KdTreeAccel_base::writeToFile(const char *filename,
+                                   const int *items, uint numItems,
+                                   const MantaKDTreeNode *nodes, uint numNodes) {
   // write item list and node lists to file
   ofstream out(filename, ios::out | ios::binary);
   if (!out) return false;
   
-  const unsigned int itemList_size = itemList.size();
-  const unsigned int nodeList_size = nodeList.size();
-  out.write((char*) &itemList_size, sizeof(itemList_size));
-  out.write((char*) &itemList[0], sizeof(itemList[0])*itemList_size);
-  out.write((char*) &nodeList_size, sizeof(nodeList_size));
-  out.write((char*) &nodeList[0], sizeof(nodeList[0])*nodeList_size);
+  out.write((char*) &numItems, sizeof(numItems));
+  out.write((char*) items, sizeof(*items)*numItems);
+  out.write((char*) &numNodes, sizeof(numNodes));
+  out.write((char*) nodes, sizeof(*nodes)*numNodes);
   out.close();
-  return true;
-}
-
-void KdTreeAccel_base::packNodesAndItems(KdTreeNode * nodePtr, 
-                                         const int nodeIdx, 
-                                         vector<int> & itemList, 
-                                         vector<MantaKDTreeNode> & nodeList) {
-  MantaKDTreeNode & node = nodeList[nodeIdx];
-  // 	node.isLeaf = nodePtr == NULL || (nodePtr->left == NULL && nodePtr->right == NULL);
-  if (nodePtr == NULL) { // empty leaf node
-    node.isLeaf = true;
-    node.numPrimitives = 0;
-    node.childIdx = itemList.size();
-  } else if (nodePtr->left == NULL && nodePtr->right == NULL) { // leaf
-    node.isLeaf = true;
-    node.numPrimitives = nodePtr->triangleIndices->size();
-    node.childIdx = itemList.size();
-    for (int i = 0; i < nodePtr->triangleIndices->size(); i++)
-      itemList.push_back((*nodePtr->triangleIndices)[i]);
-  } else {
-    node.planePos = nodePtr->splitEdge->t;
-    node.planeDim = nodePtr->splitEdge->axis;
-    node.childIdx = nodeList.size();
-    nodeList.push_back(MantaKDTreeNode());	// left child
-    nodeList.push_back(MantaKDTreeNode());	// right child
-    packNodesAndItems(nodePtr->left, nodeList[nodeIdx].childIdx, itemList, nodeList);
-    packNodesAndItems(nodePtr->right, nodeList[nodeIdx].childIdx+1, itemList, nodeList);
-  }
+  return out.good();
 }
 
-void KdTreeAccel_base::printGraphviz() const {
-  ofstream out("output.dot");
-  out << "digraph g {" << endl;
-  out << "ratio=compress; fontsize=8; colorscheme=paired12;" << endl;
-  out << "node [shape = record,height=.1];" << endl;
-  out << "\"" << (void*)m_root << "\"";
-  out << "[label = \"";
-  if (m_root->triangleIndices) {
-    out << "root:" << m_root->triangleIndices->size();
-  } else {
-    out << "root: 0";
-  }
-  out << "\"];" << endl;
-  printGraphvizHelper(m_root, out, 1);
-  out << "}" << endl;
-  out.close();
+bool KdTreeAccel_base::snapshotAt(uint depth) const {
+  return depth < m_maxDepth &&
+    find(m_options.snapshotDepths.begin(), m_options.snapshotDepths.end(),
+         depth) != m_options.snapshotDepths.end();
 }
 
-void KdTreeAccel_base::printGraphvizAccm() const {
-  ofstream out("output.dot");
-  out << "digraph g {" << endl;
-  out << "ratio=compress; fontsize=8; colorscheme=paired12;" << endl;
-  out << "node [shape = record,height=.1];" << endl;
-  out << "\"" << (void*)m_root << "\"";
-  out << "[label = \"";
-  if (m_root->triangleIndices) {
-    out << "root:" << m_root->triangleIndices->size();
-  } else {
-    out << "root: 0";
-  }
-  out << "\"];" << endl;
-  printGraphvizHelper(m_root, out, 1, m_root->triangleIndices->size());
-  out << "}" << endl;
-  out.close();
+void KdTreeAccel_base::beginBuild() {
+  m_budgetStart = tbb::tick_count::now();
+  m_cancelled = false;
+  m_nodesCompleted = 0;
+  m_edgesProcessed = 0;
+  m_lazyBuilt = 0;
 }
 
-void KdTreeAccel_base::printTreeHelper(KdTreeNode *node) const
-{
-  if (node->triangleIndices) {
-    // prefix traversal
-    sort(node->triangleIndices->begin(), node->triangleIndices->end());
-    copy(node->triangleIndices->begin(), node->triangleIndices->end(),
-         ostream_iterator<int>(cout, " "));
-    cout << endl;
+bool KdTreeAccel_base::checkCancel() {
+  if (m_cancel && m_cancel->cancelled()) {
+    m_cancelled = true;
   }
+  return m_cancelled;
+}
 
-  if (node->left != NULL)
-    printTreeHelper(node->left);
-  if (node->right != NULL)
-    printTreeHelper(node->right);
+void KdTreeAccel_base::reportProgress(uint level, uint nodes, size_t edges) {
+  if (!m_progress) return;
+  uint nodesCompleted = m_nodesCompleted += nodes;
+  size_t edgesProcessed = m_edgesProcessed += edges;
+  m_progress->progress(level, nodesCompleted, edgesProcessed);
 }
 
-// { pointer to task, color id }
-std::map<long,int> colors;
-const int color_limit = 12;
-int color_i = 0;
+void KdTreeAccel_base::discardTree() {
+  m_root = NULL;
+  vector<int>().swap(m_packedItems);
+  vector<MantaKDTreeNode>().swap(m_packedNodes);
+  vector<TreeSnapshot>().swap(m_snapshots);
+  m_leavesUnpacked = false;
+}
 
-int getNextColor() {
-  return (color_i++)%color_limit + 1;
+double KdTreeAccel_base::budgetLeftMs() const {
+  if (m_options.budgetMs == 0) return numeric_limits<double>::max();
+  return m_options.budgetMs
+    - (tbb::tick_count::now() - m_budgetStart).seconds() * 1000.0;
 }
 
-void KdTreeAccel_base::printGraphvizHelper(KdTreeNode *node, ostream &out,
-                                           unsigned int level) const {
-  if (node->left) {
-    out << "\"" << (void*)node->left << "\""
-        << "[label=\"" << level << ": ";
-    if (node->left->triangleIndices) {
-      out << node->left->triangleIndices->size();
-    } else {
-      out << 0;
-    }
-    out << "\"];";
-    out << "\"" << (void*)node << "\"";
-    out << " -> ";
-    out << "\"" << (void*)node->left << "\"";
-    out << ";" << endl;
-  }
+void KdTreeAccel_base::unpackLeaves() const {
+  if (!packed() || m_leavesUnpacked) return;
+  // concurrent locate()s
+  tbb::spin_mutex::scoped_lock lock(m_unpackMutex);
+  if (m_leavesUnpacked) return;
+  unpackLeavesHelper(m_root, 0);
+  m_leavesUnpacked = true;
+}
 
-  if (node->right) {
-    out << "\"" << (void*)node->right << "\""
-        << "[label=\"" << level << ": ";
-    if (node->right->triangleIndices) {
-      out << node->right->triangleIndices->size();
-    } else {
-      out << 0;
-    }
-    out << "\"];";
-    out << "\"" << (void*)node << "\"";
-    out << " -> ";
-    out << "\"" << (void*)node->right << "\"";
-    out << ";" << endl;
+void KdTreeAccel_base::unpackLeavesHelper(KdTreeNode *node, uint nodeIdx) const {
+  const MantaKDTreeNode &packedNode = m_packedNodes[nodeIdx];
+  if (!node->triangleIndices) {
+    node->triangleIndices = new vector<int>();
   }
-  if (node->left) {
-    printGraphvizHelper(node->left, out, level+1);
-  }
-  if (node->right) {
-    printGraphvizHelper(node->right, out, level+1);
+  if (packedNode.isLeaf) {
+    const int *items = &m_packedItems[0] + packedNode.childIdx;
+    node->triangleIndices->assign(items, items + packedNode.numPrimitives);
+    return;
   }
+  if (node->left) unpackLeavesHelper(node->left, packedNode.childIdx);
+  if (node->right) unpackLeavesHelper(node->right, packedNode.childIdx+1);
 }
 
-void KdTreeAccel_base::printGraphvizHelper(KdTreeNode *node, ostream &out,
-                                           unsigned int level, uint accm) const {
-  accm += node->triangleIndices->size();
-  if (node->left) {
-    out << "\"" << (void*)node->left << "\""
-        << "[label=\"" << level << ": ";
-    if (node->left->triangleIndices) {
-      out << accm+node->left->triangleIndices->size();
-    } else {
-      out << accm;
-    }
-    out << "\"];";
-    out << "\"" << (void*)node << "\"";
-    out << " -> ";
-    out << "\"" << (void*)node->left << "\"";
-    out << ";" << endl;
+// runs on the caller's scheduler (see KdTreeBuilder)
+void KdTreeAccel_base::computeTreeQuality(TreeQuality &quality) const {
+  unpackLeaves();
+  quality.compute(m_root, sah, m_geometry.numTriangles());
+}
+
+const KdTreeNode *KdTreeAccel_base::locate(const Vec3f &p) {
+  unpackLeaves();
+  KdTreeNode *node = m_root;
+  if (!node) return NULL;
+  for (uint i=0;i<3;i++) {
+    if (p[i] < node->extent.min[i] || p[i] > node->extent.max[i]) return NULL;
   }
-  if (node->right) {
-    out << "\"" << (void*)node->right << "\""
-        << "[label=\"" << level << ": ";
-    if (node->right->triangleIndices) {
-      out << accm+node->right->triangleIndices->size();
-    } else {
-      out << accm;
+
+  while (node) {
+    if (node->lazy && expandLazy(node)) {
+      m_lazyBuilt++;
     }
-    out << "\"];";
-    out << "\"" << (void*)node << "\"";
-    out << " -> ";
-    out << "\"" << (void*)node->right << "\"";
-    out << ";" << endl;
+    if (!node->splitEdge) return node;
+    node = p[node->splitEdge->axis] < node->splitEdge->t ?
+      node->left : node->right;
   }
-  if (node->left) {
-    printGraphvizHelper(node->left, out, level+1, accm);
-  }
-  if (node->right) {
-    printGraphvizHelper(node->right, out, level+1, accm);
+  return NULL;
+}
+
+void KdTreeAccel_base::printGraphviz() const {
+  writeGraphviz(TREETEXT_GRAPHVIZ);
+}
+
+void KdTreeAccel_base::printGraphvizAccm() const {
+  writeGraphviz(TREETEXT_GRAPHVIZ_ACCM);
+}
+
+void KdTreeAccel_base::writeGraphviz(TreeTextMode mode) const {
+  unpackLeaves();
+  string text = "digraph g {\n"
+    "ratio=compress; fontsize=8; colorscheme=paired12;\n"
+    "node [shape = record,height=.1];\n";
+  TreeText_task::appendNode(text, m_root);
+  if (m_root->triangleIndices) {
+    text += "[label = \"root:";
+    TreeText_task::appendInt(text, m_root->triangleIndices->size());
+  } else {
+    text += "[label = \"root: 0";
   }
+  text += "\"];\n";
+
+  ofstream out("output.dot");
+  out.write(text.data(), text.size());
+  // (the accumulated labels have always counted the root twice)
+  writeTreeText(out, mode, 1,
+                mode == TREETEXT_GRAPHVIZ_ACCM ? TreeText_task::size(m_root) : 0);
+  out << "}\n";
+  out.close();
+}
+
+void KdTreeAccel_base::printTree() const {
+  unpackLeaves();
+  writeTreeText(cout, TREETEXT_LIST, 0, 0);
+  cout.flush();
+}
+
+// formats subtrees concurrently into separate buffers, then writes them
+// in order
+void KdTreeAccel_base::writeTreeText(ostream &out, TreeTextMode mode,
+                                     uint level, uint accm) const {
+  if (!m_root) return;
+  vector<string> pieces(1 << (TREETEXT_SPAWN_DEPTH+1));
+  tbb::task::spawn_root_and_wait(*new(tbb::task::allocate_root())
+                                 TreeText_task(m_root, 0, 1, mode, level, accm, pieces));
+  TreeText_task::write(pieces, 1, out);
 }
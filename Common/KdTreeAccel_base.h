@@ -43,20 +43,28 @@
 #include <vector>
 #include <iostream>
 
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+
 #include "KdTreeNode.h"
-#include "TriangleMesh.h"
+#include "Vec3f.h"
+#include "GeometryView.h"
 #include "MantaKDTreeNode.h"
 #include "SAH.h"
+#include "TreeQuality.h"
+#include "Tracer.h"
+#include "PerfCounters.h"
+#include "BuildOptions.h"
+#include "TreeText_task.h"
+#include "TreeSnapshot.h"
+#include "BuildProgress.h"
 
 class KdTreeAccel_base {
 public:
-  KdTreeAccel_base(TriangleMesh *mesh, 
-                   uint numThreads, uint max_depth, 
-                   float Ct = Ct_DEFAULT,
-                   float Ci = Ci_DEFAULT,
-                   float emptyBonus = emptyBonus_DEFAULT);
+  // the view is copied, but the buffers behind it have to outlive the accel
+  KdTreeAccel_base(const GeometryView &geometry, const BuildOptions &options);
   
-  ~KdTreeAccel_base() { 
+  virtual ~KdTreeAccel_base() { 
     // don't do anything here, kdTreeAccel_tbb2 uses custom alloc
   }
   
@@ -67,29 +75,136 @@ public:
   virtual void printTimingStatsCSVHeader(std::ostream &out) = 0;
   virtual void printTimingStatsCSV(std::ostream &out) = 0;
 
-  bool writeToFile(char * filename);
+  bool writeToFile(const char * filename);
+  static bool writeToFile(const char *filename, const std::vector<int> &itemList,
+                          const std::vector<MantaKDTreeNode> &nodeList);
+  static bool writeToFile(const char *filename, const int *items, uint numItems,
+                          const MantaKDTreeNode *nodes, uint numNodes);
+  // the tree in writeToFile()'s (Manta) layout; a copy of the packed arrays
+  // for builders that produce them directly
+  void packTree(std::vector<int> &itemList,
+                std::vector<MantaKDTreeNode> &nodeList) const;
+  bool packed() const { return !m_packedNodes.empty(); }
   
-  void printTree() const {printTreeHelper(m_root);}
+  // swap in the geometry to build over; only between builds
+  void setGeometry(const GeometryView &geometry) { m_geometry = geometry; }
+  const GeometryView &geometry() const { return m_geometry; }
+
+  const BuildOptions &options() const { return m_options; }
+
+  // the shallower trees captured by the last build, in increasing depth
+  const std::vector<TreeSnapshot> &snapshots() const { return m_snapshots; }
+  const KdTreeNode *root() const { unpackLeaves(); return m_root; }
+
+  void printTree() const;
   void printGraphviz() const;
   void printGraphvizAccm() const;
 
+  // post-build analysis of the constructed tree
+  void computeTreeQuality(TreeQuality &quality) const;
+
+  // the leaf containing p; NULL outside the tree or in an empty child.
+  // Subtrees the build left for later (BuildOptions::lazyDepth) are built
+  // on the way, once, by whichever query gets there first. Safe to call
+  // from several threads at once, but not during a build.
+  const KdTreeNode *locate(const Vec3f &p);
+  // subtrees locate() has built since the last build
+  uint lazyBuilt() const { return m_lazyBuilt; }
+
+  // Bring the tree up to date after some triangles moved: changed[i] now
+  // has the bounds bounds[i]. The nodes overlapping a changed triangle's
+  // old or new bounds are patched, and the largest subtrees whose SAH cost
+  // grew by more than threshold (0.1: 10%) are built again; every other
+  // node stays as it is. Needs a build with BuildOptions::incremental
+  // (nested builder only); false if the tree cannot be updated.
+  virtual bool rebuild(const std::vector<int> &changed,
+                       const std::vector<BoundingBox> &bounds,
+                       float threshold) { return false; }
+  // subtrees the last rebuild() built again
+  uint subtreesRebuilt() const { return m_subtreesRebuilt; }
+
+  // what remains of options().budgetMs, in milliseconds; unbounded
+  // without a budget
+  double budgetLeftMs() const;
+
+  // optional per-task timeline; NULL (the default) disables tracing
+  void setTracer(Tracer *tracer) { m_tracer = tracer; }
+  Tracer *tracer() const { return m_tracer; }
+
+  // optional hardware counters per phase; NULL (the default) disables them
+  void setPerfCounters(PerfCounters *perf) { m_perf = perf; }
+  PerfCounters *perfCounters() const { return m_perf; }
+
+  // optional progress reports and cancellation; NULL (the default)
+  // disables them
+  void setProgress(BuildProgress *progress) { m_progress = progress; }
+  BuildProgress *progress() const { return m_progress; }
+  void setCancelToken(const CancelToken *cancel) { m_cancel = cancel; }
+  const CancelToken *cancelToken() const { return m_cancel; }
+
+  // the last build gave up on a cancel() and left no tree
+  bool cancelled() const { return m_cancelled; }
+
+  // for the builders and their tasks: whether to give up (once true, stays
+  // true for the rest of the build), and work done for the progress reports
+  bool checkCancel();
+  void reportProgress(uint level, uint nodes, size_t edges);
+
   const SAH sah;
 
 protected:
   KdTreeNode *m_root;
-  const TriangleMesh *m_mesh;
+  GeometryView m_geometry;
 
+  const BuildOptions m_options;
   uint m_numThreads;
   uint m_maxDepth;
 
-  void printTreeHelper(KdTreeNode *node) const;
-  void printGraphvizHelper(KdTreeNode *node, std::ostream &out, unsigned int level) const;
-  // this version accumulates branch node triangles down to children
-  void printGraphvizHelper(KdTreeNode *node, std::ostream &out, unsigned int level, uint accm) const;
+  Tracer *m_tracer;
+  PerfCounters *m_perf;
+
+  // the tree already flattened by the builder, nodes breadth-first; when
+  // set, the nodes under m_root get their triangleIndices from it only if
+  // somebody looks at them (see unpackLeaves)
+  std::vector<int> m_packedItems;
+  std::vector<MantaKDTreeNode> m_packedNodes;
+  mutable tbb::atomic<bool> m_leavesUnpacked;
+  mutable tbb::spin_mutex m_unpackMutex;
+
+  std::vector<TreeSnapshot> m_snapshots;
+  bool snapshotAt(uint depth) const;
+
+  // BuildOptions::outOfCoreDir for OutOfCoreAllocator; NULL if unset
+  const char *outOfCoreDir() const {
+    return m_options.outOfCoreDir.empty() ? NULL : m_options.outOfCoreDir.c_str();
+  }
+
+  // builders call this first thing in build(): starts the budget clock and
+  // the progress counts
+  void beginBuild();
+  tbb::tick_count m_budgetStart;
+
+  BuildProgress *m_progress;
+  const CancelToken *m_cancel;
+  tbb::atomic<bool> m_cancelled;
+  tbb::atomic<uint> m_nodesCompleted;
+  tbb::atomic<size_t> m_edgesProcessed;
+
+  // a cancelled build drops the tree; the builder frees its nodes first
+  void discardTree();
+
+  // builders that leave lazy nodes build their subtrees here: node becomes
+  // the root of its subtree, unless that has happened already (false)
+  virtual bool expandLazy(KdTreeNode *node) { return false; }
+  tbb::atomic<uint> m_lazyBuilt;
+  uint m_subtreesRebuilt;
+
+  void unpackLeaves() const;
+  void unpackLeavesHelper(KdTreeNode *node, uint nodeIdx) const;
 
-  // useful for writing kd-tree to file
-  void packNodesAndItems(KdTreeNode * nodePtr, const int nodeIdx, 
-                         std::vector<int> & itemList, std::vector<MantaKDTreeNode> & nodeList);
+  void writeTreeText(std::ostream &out, TreeTextMode mode,
+                     uint level, uint accm) const;
+  void writeGraphviz(TreeTextMode mode) const;
 };
 
 
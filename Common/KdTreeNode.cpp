@@ -41,7 +41,7 @@
 
 
 KdTreeNode::KdTreeNode() : left(NULL), right(NULL), custom_mm(false), splitEdge(NULL),
-                           triangleIndices(NULL) { }
+                           triangleIndices(NULL), lazy(false) { }
   
 KdTreeNode::~KdTreeNode() {
   if (custom_mm) {
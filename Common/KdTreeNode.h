@@ -48,7 +48,8 @@
 class KdTreeNode {
 public:
   KdTreeNode();  
-  ~KdTreeNode();
+  // virtual: lazy nodes (Accel-nested) are deleted through KdTreeNode*
+  virtual ~KdTreeNode();
 
   BoundingBox extent;
 
@@ -60,7 +61,11 @@ public:
   const BoxEdge *splitEdge;
 
   // leaf node variables
-  std::vector<int> *triangleIndices;	// array of indices into triangleMesh::triangleList
+  std::vector<int> *triangleIndices;	// array of triangle indices into TriangleMesh
+
+  // a leaf standing in for a subtree the builder left for later (see
+  // BuildOptions::lazyDepth and KdTreeAccel_base::locate())
+  bool lazy;
 
 protected:
   bool custom_mm;
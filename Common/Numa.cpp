@@ -0,0 +1,239 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include <fstream>
+#include <sstream>
+#include <map>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/partitioner.h>
+
+#include "Numa.h"
+
+using namespace std;
+using namespace tbb;
+
+// node masks as the kernel takes them; enough for any machine we run on
+static const unsigned long MAX_NODES = 1024;
+static const unsigned long BITS_PER_LONG = 8*sizeof(unsigned long);
+
+struct NodeMask {
+  unsigned long bits[MAX_NODES/BITS_PER_LONG];
+
+  NodeMask() { memset(bits, 0, sizeof(bits)); }
+  void set(uint node) { bits[node/BITS_PER_LONG] |= 1UL << (node%BITS_PER_LONG); }
+  bool test(uint node) const {
+    return bits[node/BITS_PER_LONG] & (1UL << (node%BITS_PER_LONG));
+  }
+};
+
+// no libnuma needed for these three
+static bool allowed_nodes(NodeMask &mask) {
+  return syscall(SYS_get_mempolicy, NULL, mask.bits, MAX_NODES, NULL,
+                 MPOL_F_MEMS_ALLOWED) == 0;
+}
+
+static void move_pages_to(char *begin, char *end, int mode,
+                          const NodeMask &mask) {
+  if (begin < end) {
+    syscall(SYS_mbind, begin, end - begin, mode, mask.bits, MAX_NODES,
+            MPOL_MF_MOVE);
+  }
+}
+
+static uint current_node() {
+  unsigned int cpu = 0, node = 0;
+  syscall(SYS_getcpu, &cpu, &node, NULL);
+  return node;
+}
+
+uint numaNodeCount() {
+  NodeMask mask;
+  if (!allowed_nodes(mask)) return 1;
+
+  uint count = 0;
+  for (uint node=0;node<MAX_NODES;node++) {
+    if (mask.test(node)) count++;
+  }
+  return count ? count : 1;
+}
+
+vector<cpu_set_t> numaNodeCpus() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  sched_getaffinity(0, sizeof(allowed), &allowed);
+
+  vector<cpu_set_t> sets;
+  NodeMask nodes;
+  if (allowed_nodes(nodes)) {
+    for (uint node=0;node<MAX_NODES;node++) {
+      if (!nodes.test(node)) continue;
+
+      // e.g. "0-7,16-23"
+      ostringstream path;
+      path << "/sys/devices/system/node/node" << node << "/cpulist";
+      ifstream in(path.str().c_str());
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      int lo, hi;
+      while (in >> lo) {
+        hi = lo;
+        if (in.peek() == '-') {
+          in.get();
+          in >> hi;
+        }
+        for (int cpu=lo;cpu<=hi && cpu<CPU_SETSIZE;cpu++) {
+          if (CPU_ISSET(cpu, &allowed)) CPU_SET(cpu, &set);
+        }
+        if (in.peek() == ',') in.get();
+      }
+      if (CPU_COUNT(&set) > 0) sets.push_back(set);
+    }
+  }
+  if (sets.empty()) sets.push_back(allowed);
+  return sets;
+}
+
+class NumaPlace_task {
+public:
+  char *data;
+  size_t bytes;
+  uint chunks;
+  size_t page;
+
+  NumaPlace_task(char *data, size_t bytes, uint chunks, size_t page)
+    : data(data), bytes(bytes), chunks(chunks), page(page) {}
+
+  // chunk c starts at the page holding its first byte; a page on a chunk
+  // boundary goes with the chunk that starts in it
+  char *chunkBegin(uint c) const {
+    if (c == chunks) {
+      return (char *)(((size_t)(data + bytes) + page - 1) & ~(page - 1));
+    }
+    return (char *)((size_t)(data + bytes*c/chunks) & ~(page - 1));
+  }
+
+  void operator()(const blocked_range<uint> &r) const {
+    NodeMask mask;
+    mask.set(current_node());
+    for (uint c=r.begin();c<r.end();c++) {
+      move_pages_to(chunkBegin(c), chunkBegin(c+1), MPOL_PREFERRED, mask);
+    }
+  }
+};
+
+void numaPlace(const void *data, size_t bytes, NumaPolicy policy,
+               uint chunks) {
+  if (policy == NUMA_DEFAULT || bytes == 0) return;
+
+  NodeMask nodes;
+  if (!allowed_nodes(nodes) || numaNodeCount() < 2) return;
+
+  size_t page = sysconf(_SC_PAGESIZE);
+  NumaPlace_task place((char *)data, bytes, chunks ? chunks : 1, page);
+
+  if (policy == NUMA_INTERLEAVE) {
+    move_pages_to(place.chunkBegin(0), place.chunkBegin(place.chunks),
+                  MPOL_INTERLEAVE, nodes);
+  } else {
+    parallel_for(blocked_range<uint>(0, place.chunks, 1), place,
+                 simple_partitioner());
+  }
+}
+
+// socket of cpu, 0 if unknown
+static int cpu_package(int cpu) {
+  ostringstream path;
+  path << "/sys/devices/system/cpu/cpu" << cpu
+       << "/topology/physical_package_id";
+  ifstream in(path.str().c_str());
+  int package = 0;
+  in >> package;
+  return in ? package : 0;
+}
+
+ThreadPinner::ThreadPinner(ThreadPinning pinning) {
+  m_next = 0;
+  if (pinning == PIN_NONE) return;
+
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    perror("sched_getaffinity");
+    return;
+  }
+
+  map<int, cpu_set_t> packages;
+  for (int cpu=0;cpu<CPU_SETSIZE;cpu++) {
+    if (!CPU_ISSET(cpu, &allowed)) continue;
+
+    if (pinning == PIN_CORES) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      m_sets.push_back(set);
+    } else {
+      int package = cpu_package(cpu);
+      if (!packages.count(package)) CPU_ZERO(&packages[package]);
+      CPU_SET(cpu, &packages[package]);
+    }
+  }
+  for (map<int, cpu_set_t>::iterator I=packages.begin(), E=packages.end();
+       I!=E; I++) {
+    m_sets.push_back(I->second);
+  }
+
+  if (!m_sets.empty()) observe(true);
+}
+
+ThreadPinner::~ThreadPinner() {
+  if (!m_sets.empty()) observe(false);
+}
+
+void ThreadPinner::on_scheduler_entry(bool is_worker) {
+  uint i = m_next++;
+  sched_setaffinity(0, sizeof(cpu_set_t), &m_sets[i % m_sets.size()]);
+}
@@ -0,0 +1,105 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _NUMA_H_
+#define _NUMA_H_
+
+#include <stddef.h>
+#include <sched.h>
+#include <vector>
+
+#include <tbb/atomic.h>
+#include <tbb/task_scheduler_observer.h>
+
+#include "common.h"
+
+// Where the pages of the big build arrays go on a multi-socket machine.
+// By default they land on the node of the thread that allocates and
+// initializes them (the main thread), so every worker on another socket
+// reads them over the interconnect.
+enum NumaPolicy {
+  NUMA_DEFAULT,     // leave placement to the kernel
+  NUMA_FIRST_TOUCH, // each chunk on the node of the thread that places it
+  NUMA_INTERLEAVE   // pages round-robin over all allowed nodes
+};
+
+enum ThreadPinning {
+  PIN_NONE,
+  PIN_CORES,   // each pool thread to one CPU, in CPU order
+  PIN_SOCKETS  // each pool thread to all CPUs of one socket, round-robin
+};
+
+// number of memory nodes this process may allocate on (1 without NUMA)
+uint numaNodeCount();
+
+// the allowed CPUs of each memory node that has any, in node order; a
+// single set of all allowed CPUs without NUMA
+std::vector<cpu_set_t> numaNodeCpus();
+
+// Place the pages of [data, data+bytes) by policy, moving pages that are
+// already there. For NUMA_FIRST_TOUCH the range is cut into chunks equal
+// parts -- pass the same count the build phases use for the array -- and
+// one task per chunk moves its part to the node it runs on. Best effort:
+// does nothing with a single node or if the kernel refuses.
+void numaPlace(const void *data, size_t bytes, NumaPolicy policy,
+               uint chunks);
+
+template <class V>
+inline void numaPlace(const V &v, NumaPolicy policy, uint chunks) {
+  if (policy != NUMA_DEFAULT && !v.empty()) {
+    numaPlace(&v[0], v.size()*sizeof(v[0]), policy, chunks);
+  }
+}
+
+// Pins pool threads as they join the scheduler. Has to exist before the
+// scheduler starts (KdTreeBuilder creates it first).
+class ThreadPinner : public tbb::task_scheduler_observer {
+public:
+  explicit ThreadPinner(ThreadPinning pinning);
+  ~ThreadPinner();
+
+  // tbb::task_scheduler_observer
+  void on_scheduler_entry(bool is_worker);
+
+private:
+  std::vector<cpu_set_t> m_sets; // handed out round-robin
+  tbb::atomic<uint> m_next;
+};
+
+#endif // _NUMA_H_
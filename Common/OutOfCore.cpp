@@ -0,0 +1,79 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <string>
+#include <vector>
+
+#include "OutOfCore.h"
+
+using namespace std;
+
+void *outOfCoreAllocate(size_t bytes, const char *dir) {
+  string name = string(dir) + "/parkd-XXXXXX";
+  vector<char> path(name.begin(), name.end());
+  path.push_back('\0');
+
+  int fd = mkstemp(&path[0]);
+  if (fd < 0) {
+    throw bad_alloc();
+  }
+  // the mapping keeps the file alive; nothing is left behind on exit
+  unlink(&path[0]);
+  if (ftruncate(fd, bytes) != 0) {
+    close(fd);
+    throw bad_alloc();
+  }
+  void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    throw bad_alloc();
+  }
+
+  // the level sweeps stream through the arrays: read ahead, drop behind
+  madvise(p, bytes, MADV_SEQUENTIAL);
+  return p;
+}
+
+void outOfCoreFree(void *p, size_t bytes) {
+  munmap(p, bytes);
+}
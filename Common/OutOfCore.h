@@ -0,0 +1,129 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _OUTOFCORE_H_
+#define _OUTOFCORE_H_
+
+#include <stddef.h>
+#include <new>
+#include <limits>
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include "common.h"
+
+// Blocks at least this big go to a file when out of core
+#define OUTOFCORE_MIN_BYTES (1 << 20)
+
+// A block of bytes mapped shared from a new, already unlinked file in dir,
+// with a sequential-access hint. The kernel writes its pages back to the
+// file and drops them under memory pressure, so arrays that are swept
+// front to back need not fit in RAM. Throws std::bad_alloc on failure.
+void *outOfCoreAllocate(size_t bytes, const char *dir);
+void outOfCoreFree(void *p, size_t bytes);
+
+// Allocator for the big, streamed build arrays (--out-of-core). With a
+// directory, big blocks come from outOfCoreAllocate; without one, and for
+// small blocks, it is tbb::cache_aligned_allocator. Which one is decided by
+// the directory and the block size alone, so any two allocators with or
+// without a directory can free each other's blocks.
+template <class T>
+class OutOfCoreAllocator {
+public:
+  typedef T value_type;
+  typedef T *pointer;
+  typedef const T *const_pointer;
+  typedef T &reference;
+  typedef const T &const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  template <class U> struct rebind { typedef OutOfCoreAllocator<U> other; };
+
+  // dir has to outlive the allocator and everything it allocates
+  OutOfCoreAllocator(const char *dir = NULL) throw() : m_dir(dir) { }
+  template <class U>
+  OutOfCoreAllocator(const OutOfCoreAllocator<U> &other) throw()
+    : m_dir(other.dir()) { }
+
+  pointer allocate(size_type n, const void * = 0) {
+    if (onFile(n)) {
+      return static_cast<pointer>(outOfCoreAllocate(n*sizeof(T), m_dir));
+    }
+    return tbb::cache_aligned_allocator<T>().allocate(n);
+  }
+
+  void deallocate(pointer p, size_type n) {
+    if (onFile(n)) {
+      outOfCoreFree(p, n*sizeof(T));
+    } else {
+      tbb::cache_aligned_allocator<T>().deallocate(p, n);
+    }
+  }
+
+  size_type max_size() const throw() {
+    return std::numeric_limits<size_type>::max() / sizeof(T);
+  }
+  void construct(pointer p, const T &value) { new(static_cast<void*>(p)) T(value); }
+  void destroy(pointer p) { p->~T(); }
+  pointer address(reference x) const { return &x; }
+  const_pointer address(const_reference x) const { return &x; }
+
+  const char *dir() const { return m_dir; }
+
+private:
+  bool onFile(size_type n) const {
+    return m_dir && n*sizeof(T) >= OUTOFCORE_MIN_BYTES;
+  }
+
+  const char *m_dir;
+};
+
+template <class T, class U>
+inline bool operator==(const OutOfCoreAllocator<T> &a,
+                       const OutOfCoreAllocator<U> &b) {
+  return (a.dir() == NULL) == (b.dir() == NULL);
+}
+
+template <class T, class U>
+inline bool operator!=(const OutOfCoreAllocator<T> &a,
+                       const OutOfCoreAllocator<U> &b) {
+  return !(a == b);
+}
+
+#endif // _OUTOFCORE_H_
@@ -0,0 +1,183 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _PACKTREE_TASK_H_
+#define _PACKTREE_TASK_H_
+
+#include <vector>
+
+#include <tbb/task.h>
+
+#include "KdTreeNode.h"
+#include "MantaKDTreeNode.h"
+
+// subtrees below this depth are counted and filled serially by one task
+#define PACKTREE_SPAWN_DEPTH 8
+
+// what a subtree adds to the packed tree below its own node
+struct PackCount {
+  uint nodes; // child slots of all its interior nodes
+  uint items; // triangle references of all its leaves
+};
+
+// heap-numbered (root 1, children 2h and 2h+1) down to PACKTREE_SPAWN_DEPTH
+typedef std::vector<PackCount> v_PackCount;
+
+static inline bool isPackLeaf(const KdTreeNode *node) {
+  return node == NULL || (node->left == NULL && node->right == NULL);
+}
+
+// Bottom-up pass: counts[h] for every node above the spawn depth.
+class PackCount_task : public tbb::task {
+public:
+  PackCount_task(const KdTreeNode *node, uint depth, uint h, v_PackCount &counts)
+    : node(node), depth(depth), h(h), counts(counts) {}
+
+  tbb::task *execute() {
+    if (depth >= PACKTREE_SPAWN_DEPTH || isPackLeaf(node)) {
+      counts[h] = walk(node);
+      return NULL;
+    }
+
+    set_ref_count(3);
+    spawn(*new(allocate_child()) PackCount_task(node->left, depth+1, 2*h, counts));
+    spawn_and_wait_for_all(*new(allocate_child()) PackCount_task(node->right, depth+1,
+                                                                 2*h+1, counts));
+    counts[h].nodes = 2 + counts[2*h].nodes + counts[2*h+1].nodes;
+    counts[h].items = counts[2*h].items + counts[2*h+1].items;
+    return NULL;
+  }
+
+  static PackCount walk(const KdTreeNode *root) {
+    PackCount c = { 0, 0 };
+    std::vector<const KdTreeNode*> stack(1, root);
+    while (!stack.empty()) {
+      const KdTreeNode *node = stack.back();
+      stack.pop_back();
+      if (node == NULL) continue;
+      if (isPackLeaf(node)) {
+        if (node->triangleIndices) c.items += node->triangleIndices->size();
+      } else {
+        c.nodes += 2;
+        stack.push_back(node->right);
+        stack.push_back(node->left);
+      }
+    }
+    return c;
+  }
+
+private:
+  const KdTreeNode *node;
+  const uint depth, h;
+  v_PackCount &counts;
+};
+
+// Top-down pass: writes the subtree at nodeList[slot], its child slots from
+// nodeBase and its leaves' triangles from itemBase on, in the order the
+// depth-first recursion used to append them.
+class PackFill_task : public tbb::task {
+public:
+  PackFill_task(const KdTreeNode *node, uint depth, uint h,
+                const v_PackCount &counts, uint slot, uint nodeBase, uint itemBase,
+                MantaKDTreeNode *nodeList, int *itemList)
+    : node(node), depth(depth), h(h), counts(counts), slot(slot),
+      nodeBase(nodeBase), itemBase(itemBase), nodeList(nodeList), itemList(itemList) {}
+
+  tbb::task *execute() {
+    if (depth >= PACKTREE_SPAWN_DEPTH || isPackLeaf(node)) {
+      walk(node, slot, nodeBase, itemBase, nodeList, itemList);
+      return NULL;
+    }
+
+    MantaKDTreeNode &packed = nodeList[slot];
+    packed.planePos = node->splitEdge->t;
+    packed.planeDim = node->splitEdge->axis;
+    packed.childIdx = nodeBase;
+
+    const PackCount &left = counts[2*h];
+    set_ref_count(3);
+    spawn(*new(allocate_child()) PackFill_task(node->left, depth+1, 2*h, counts,
+                                               nodeBase, nodeBase+2, itemBase,
+                                               nodeList, itemList));
+    spawn_and_wait_for_all(*new(allocate_child())
+                           PackFill_task(node->right, depth+1, 2*h+1, counts,
+                                         nodeBase+1, nodeBase+2+left.nodes,
+                                         itemBase+left.items, nodeList, itemList));
+    return NULL;
+  }
+
+  static void walk(const KdTreeNode *root, uint slot, uint nodeBase, uint itemBase,
+                   MantaKDTreeNode *nodeList, int *itemList) {
+    // (node, slot) pairs; popping the left child first keeps the order
+    std::vector<std::pair<const KdTreeNode*, uint> > stack;
+    stack.push_back(std::make_pair(root, slot));
+    while (!stack.empty()) {
+      const KdTreeNode *node = stack.back().first;
+      MantaKDTreeNode &packed = nodeList[stack.back().second];
+      stack.pop_back();
+
+      if (isPackLeaf(node)) {
+        uint size = (node && node->triangleIndices) ? node->triangleIndices->size() : 0;
+        packed.isLeaf = true;
+        packed.numPrimitives = size;
+        packed.childIdx = itemBase;
+        for (uint i=0;i<size;i++) {
+          itemList[itemBase++] = (*node->triangleIndices)[i];
+        }
+      } else {
+        packed.planePos = node->splitEdge->t;
+        packed.planeDim = node->splitEdge->axis;
+        packed.childIdx = nodeBase;
+        stack.push_back(std::make_pair((const KdTreeNode*)node->right, nodeBase+1));
+        stack.push_back(std::make_pair((const KdTreeNode*)node->left, nodeBase));
+        nodeBase += 2;
+      }
+    }
+  }
+
+private:
+  const KdTreeNode *node;
+  const uint depth, h;
+  const v_PackCount &counts;
+  const uint slot, nodeBase, itemBase;
+  MantaKDTreeNode *nodeList;
+  int *itemList;
+};
+
+#endif // _PACKTREE_TASK_H_
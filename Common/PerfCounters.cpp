@@ -0,0 +1,253 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#include <iomanip>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+
+#include "PerfCounters.h"
+
+using namespace std;
+
+static const char *phase_names[PERF_NUM_PHASES] = {
+  "build", "createEdges", "sort", "setupTriangles", "unpack",
+  "findBestPlane", "newGen", "classifyTriangles", "filterGeom",
+  "taskCreation", "fill"
+};
+
+static const char *event_names[PERF_NUM_EVENTS] = {
+  "cycles", "instructions", "LLC_misses", "dTLB_misses", "branch_misses"
+};
+
+// open one counter for the calling thread, user-space only
+static int open_event(PerfEvent event) {
+  struct perf_event_attr pe;
+  memset(&pe, 0, sizeof(pe));
+  pe.size = sizeof(pe);
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  pe.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  switch (event) {
+  case PERF_CYCLES:
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.config = PERF_COUNT_HW_CPU_CYCLES;
+    break;
+  case PERF_INSTRUCTIONS:
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.config = PERF_COUNT_HW_INSTRUCTIONS;
+    break;
+  case PERF_LLC_MISSES:
+    pe.type = PERF_TYPE_HW_CACHE;
+    pe.config = PERF_COUNT_HW_CACHE_LL |
+      (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    break;
+  case PERF_DTLB_MISSES:
+    pe.type = PERF_TYPE_HW_CACHE;
+    pe.config = PERF_COUNT_HW_CACHE_DTLB |
+      (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    break;
+  case PERF_BRANCH_MISSES:
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.config = PERF_COUNT_HW_BRANCH_MISSES;
+    break;
+  default:
+    return -1;
+  }
+
+  // pid 0, cpu -1: this thread, wherever it runs
+  return syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+PerfCounters::PerfCounters() : m_available(false) {
+  memset(m_start, 0, sizeof(m_start));
+  memset(m_total, 0, sizeof(m_total));
+  for (int e=0;e<PERF_NUM_EVENTS;e++) {
+    m_supported[e] = true;
+  }
+
+  // the calling (master) thread decides which events are supported
+  if (registerThread()) {
+    m_available = true;
+    observe(true);
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  if (m_available) {
+    observe(false);
+  }
+  for (uint i=0;i<m_threads.size();i++) {
+    for (int e=0;e<PERF_NUM_EVENTS;e++) {
+      if (m_threads[i].fd[e] >= 0) close(m_threads[i].fd[e]);
+    }
+  }
+}
+
+void PerfCounters::on_scheduler_entry(bool is_worker) {
+  registerThread();
+}
+
+bool PerfCounters::registerThread() {
+  int tid = syscall(SYS_gettid);
+
+  tbb::spin_mutex::scoped_lock lock(m_mutex);
+  for (uint i=0;i<m_threads.size();i++) {
+    if (m_threads[i].tid == tid) return true;
+  }
+
+  ThreadCounters tc;
+  tc.tid = tid;
+  bool first = m_threads.empty();
+  bool any = false;
+  for (int e=0;e<PERF_NUM_EVENTS;e++) {
+    tc.fd[e] = m_supported[e] ? open_event((PerfEvent)e) : -1;
+    if (tc.fd[e] < 0) {
+      if (first) {
+        m_supported[e] = false;
+        if (m_error.empty()) {
+          m_error = string(event_names[e]) + ": " + strerror(errno);
+        }
+      }
+    } else {
+      any = true;
+    }
+  }
+
+  if (!any) return false;
+  m_threads.push_back(tc);
+  return true;
+}
+
+void PerfCounters::read(uint64 *counts) {
+  memset(counts, 0, sizeof(uint64)*PERF_NUM_EVENTS);
+
+  tbb::spin_mutex::scoped_lock lock(m_mutex);
+  for (uint i=0;i<m_threads.size();i++) {
+    for (int e=0;e<PERF_NUM_EVENTS;e++) {
+      if (m_threads[i].fd[e] < 0) continue;
+
+      // { value, time enabled, time running }
+      uint64 buf[3];
+      if (::read(m_threads[i].fd[e], buf, sizeof(buf)) != sizeof(buf)) continue;
+
+      // scale up if the counter was multiplexed
+      if (buf[2] > 0 && buf[2] < buf[1]) {
+        buf[0] = (uint64)((double)buf[0] * buf[1] / buf[2]);
+      }
+      counts[e] += buf[0];
+    }
+  }
+}
+
+void PerfCounters::begin(PerfPhase phase) {
+  if (!m_available) return;
+  read(m_start[phase]);
+}
+
+void PerfCounters::end(PerfPhase phase) {
+  if (!m_available) return;
+
+  uint64 now[PERF_NUM_EVENTS];
+  read(now);
+  for (int e=0;e<PERF_NUM_EVENTS;e++) {
+    if (now[e] > m_start[phase][e]) {
+      m_total[phase][e] += now[e] - m_start[phase][e];
+    }
+  }
+}
+
+void PerfCounters::print(ostream &out) const {
+  out << "              HARDWARE COUNTERS (summed over all threads)\n\n";
+
+  if (!m_available) {
+    out << "Hardware counters unavailable (" << m_error << ")\n";
+    return;
+  }
+
+  out << setw(20) << left << "Phase";
+  for (int e=0;e<PERF_NUM_EVENTS;e++) {
+    out << setw(16) << right << event_names[e];
+  }
+  out << "\n";
+
+  for (int p=0;p<PERF_NUM_PHASES;p++) {
+    bool used = false;
+    for (int e=0;e<PERF_NUM_EVENTS;e++) {
+      used |= m_total[p][e] != 0;
+    }
+    if (!used) continue;
+
+    out << setw(20) << left << phase_names[p];
+    for (int e=0;e<PERF_NUM_EVENTS;e++) {
+      if (m_supported[e]) {
+        out << setw(16) << right << m_total[p][e];
+      } else {
+        out << setw(16) << right << "n/a";
+      }
+    }
+    out << "\n";
+  }
+
+  out << "\n" << m_threads.size() << " thread(s) counted\n";
+}
+
+void PerfCounters::printCSVHeader(ostream &out) {
+  for (int p=0;p<PERF_NUM_PHASES;p++) {
+    for (int e=0;e<PERF_NUM_EVENTS;e++) {
+      out << ",perf_" << phase_names[p] << "_" << event_names[e];
+    }
+  }
+}
+
+void PerfCounters::printCSV(ostream &out) const {
+  // unsupported counters are left empty
+  for (int p=0;p<PERF_NUM_PHASES;p++) {
+    for (int e=0;e<PERF_NUM_EVENTS;e++) {
+      out << ",";
+      if (m_available && m_supported[e]) {
+        out << m_total[p][e];
+      }
+    }
+  }
+}
@@ -0,0 +1,147 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _PERFCOUNTERS_H_
+#define _PERFCOUNTERS_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <tbb/task_scheduler_observer.h>
+#include <tbb/spin_mutex.h>
+
+#include "common.h"
+
+// Build phases counters are collected for. This is the union of the
+// phases timed by the Stats of the individual implementations; a phase an
+// implementation doesn't have simply stays at zero.
+enum PerfPhase {
+  PERF_BUILD = 0,
+  PERF_CREATEEDGES,
+  PERF_SORT,
+  PERF_SETUPTRIANGLES,
+  PERF_UNPACK,
+  PERF_FINDBESTPLANE,
+  PERF_NEWGEN,
+  PERF_CLASSIFYTRIANGLES,
+  PERF_FILTERGEOM,
+  PERF_TASKCREATION,
+  PERF_FILL,
+  PERF_NUM_PHASES
+};
+
+enum PerfEvent {
+  PERF_CYCLES = 0,
+  PERF_INSTRUCTIONS,
+  PERF_LLC_MISSES,
+  PERF_DTLB_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_NUM_EVENTS
+};
+
+// Hardware counters (perf_event_open) for every thread that joins the TBB
+// scheduler, summed over all threads per build phase (parkd --perf).
+//
+// Counters are opened by each thread for itself when it enters the
+// scheduler, so the object has to exist before the KdTreeBuilder that
+// starts the scheduler.
+// If the kernel doesn't let us count, available() is false, error() says
+// why, and begin()/end() do nothing.
+class PerfCounters : public tbb::task_scheduler_observer {
+public:
+  PerfCounters();
+  ~PerfCounters();
+
+  bool available() const { return m_available; }
+  const std::string &error() const { return m_error; }
+
+  void begin(PerfPhase phase);
+  void end(PerfPhase phase);
+
+  void print(std::ostream &out) const;
+  static void printCSVHeader(std::ostream &out);
+  void printCSV(std::ostream &out) const;
+
+  // tbb::task_scheduler_observer
+  void on_scheduler_entry(bool is_worker);
+
+private:
+  // sum of all threads' current counts
+  void read(uint64 *counts);
+  bool registerThread();
+
+  struct ThreadCounters {
+    int tid;
+    int fd[PERF_NUM_EVENTS]; // -1 if that event couldn't be opened
+  };
+
+  std::vector<ThreadCounters> m_threads;
+  tbb::spin_mutex m_mutex;
+
+  bool m_available;
+  std::string m_error;
+  bool m_supported[PERF_NUM_EVENTS];
+
+  uint64 m_start[PERF_NUM_PHASES][PERF_NUM_EVENTS];
+  uint64 m_total[PERF_NUM_PHASES][PERF_NUM_EVENTS];
+};
+
+// Counts [construction, destruction or end()) towards phase; does nothing
+// if counters is NULL.
+class PerfScope {
+public:
+  PerfScope(PerfCounters *counters, PerfPhase phase)
+    : counters(counters), phase(phase) {
+    if (counters) counters->begin(phase);
+  }
+
+  ~PerfScope() { end(); }
+
+  void end() {
+    if (counters) counters->end(phase);
+    counters = NULL;
+  }
+
+private:
+  PerfCounters *counters;
+  PerfPhase phase;
+};
+
+#endif // _PERFCOUNTERS_H_
@@ -50,7 +50,7 @@ public:
   ~Stats_base() {}
 
   virtual void printCSVHeader(std::ostream &out) = 0;
-  virtual void printCSV(std::ostream &out) = 0;
+  virtual void printCSV(std::ostream &out, bool inTicks) = 0;
 
 protected:
   uint m_maxDepth;
@@ -0,0 +1,106 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#include <fstream>
+
+#include "Tracer.h"
+
+using namespace std;
+
+Tracer::Tracer() : m_start(tbb::tick_count::now()) {
+  m_nextWorker = 0;
+}
+
+double Tracer::now() const {
+  return (tbb::tick_count::now() - m_start).seconds() * 1e6;
+}
+
+void Tracer::record(const char *name, double ts, int level, long node, long edges) {
+  bool exists;
+  Buffer &buf = m_buffers.local(exists);
+  if (!exists) {
+    // number workers in the order they first record something
+    buf.worker = m_nextWorker++;
+  }
+
+  TraceEvent e;
+  e.name = name;
+  e.ts = ts;
+  e.dur = now() - ts;
+  e.level = level;
+  e.node = node;
+  e.edges = edges;
+  buf.events.push_back(e);
+}
+
+bool Tracer::write(const char *filename) const {
+  ofstream out(filename);
+  if (!out) return false;
+
+  out << "{\"traceEvents\":[\n";
+
+  bool first = true;
+  for (ets_Buffer::const_iterator I=m_buffers.begin(), E=m_buffers.end();
+       I!=E; I++) {
+    const Buffer &buf = *I;
+
+    out << (first?"":",\n")
+        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buf.worker
+        << ",\"args\":{\"name\":\"worker " << buf.worker << "\"}}";
+    first = false;
+
+    for (vector<TraceEvent>::const_iterator J=buf.events.begin(), 
+           F=buf.events.end(); J!=F; J++) {
+      const TraceEvent &e = *J;
+      out << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"parkd\",\"ph\":\"X\""
+          << ",\"pid\":0,\"tid\":" << buf.worker
+          << ",\"ts\":" << fixed << e.ts << ",\"dur\":" << e.dur
+          << ",\"args\":{";
+      const char *sep = "";
+      if (e.level >= 0) { out << sep << "\"level\":" << e.level; sep = ","; }
+      if (e.node >= 0)  { out << sep << "\"node\":" << e.node; sep = ","; }
+      if (e.edges >= 0) { out << sep << "\"edges\":" << e.edges; }
+      out << "}}";
+    }
+  }
+
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  out.close();
+  return true;
+}
@@ -0,0 +1,113 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _TRACER_H_
+#define _TRACER_H_
+
+#include <vector>
+
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/tick_count.h>
+#include <tbb/atomic.h>
+
+// One timeline event: a task or phase that ran on one worker thread.
+// level/node/edges are -1 when they don't apply.
+struct TraceEvent {
+  const char *name;    // must be a string literal
+  double ts, dur;      // microseconds since the Tracer was created
+  int level;
+  long node;
+  long edges;
+};
+
+// Opt-in per-task timeline (parkd --trace <file>). Events are appended to
+// per-thread buffers, so recording never synchronizes; write() dumps all
+// of them in Chrome trace format (chrome://tracing, ui.perfetto.dev).
+class Tracer {
+public:
+  Tracer();
+
+  // microseconds since the Tracer was created
+  double now() const;
+
+  void record(const char *name, double ts, int level, long node, long edges);
+
+  bool write(const char *filename) const;
+
+private:
+  struct Buffer {
+    Buffer() : worker(-1) {}
+    int worker;
+    std::vector<TraceEvent> events;
+  };
+  typedef tbb::enumerable_thread_specific<Buffer> ets_Buffer;
+
+  ets_Buffer m_buffers;
+  tbb::tick_count m_start;
+  tbb::atomic<int> m_nextWorker;
+};
+
+// Records [construction, destruction or end()) as one event; does nothing
+// if the tracer is NULL, so call sites don't need to check.
+class TraceScope {
+public:
+  TraceScope(Tracer *tracer, const char *name, 
+             int level = -1, long node = -1, long edges = -1)
+    : tracer(tracer), name(name), level(level), node(node), edges(edges) {
+    if (tracer) ts = tracer->now();
+  }
+
+  ~TraceScope() { end(); }
+
+  // close the event early, for phases that don't map onto a C++ scope
+  void end() {
+    if (tracer) tracer->record(name, ts, level, node, edges);
+    tracer = NULL;
+  }
+
+private:
+  Tracer *tracer;
+  const char *name;
+  double ts;
+  int level;
+  long node;
+  long edges;
+};
+
+#endif // _TRACER_H_
@@ -0,0 +1,252 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+
+#include <tbb/task.h>
+
+#include "TreeQuality.h"
+#include "TreeQuality_task.h"
+#include "MantaKDTreeNode.h"
+
+using namespace std;
+
+static inline double surfaceArea(const BoundingBox &b) {
+  double dx = b.max[0] - b.min[0];
+  double dy = b.max[1] - b.min[1];
+  double dz = b.max[2] - b.min[2];
+  return 2.0*(dx*dy + dy*dz + dz*dx);
+}
+
+TreeQuality::TreeQuality() 
+  : interiorArea(0.0), leafArea(0.0), sahCost(0.0), 
+    interiorCount(0), leafCount(0), emptyLeafCount(0), maxLeafSize(0),
+    triangleRefs(0), numTriangles(0) { }
+
+void TreeQuality::compute(const KdTreeNode *root, const SAH &sah, 
+                          uint numTriangles) {
+  tbb::task::spawn_root_and_wait(*new(tbb::task::allocate_root()) 
+                                 TreeQuality_task(root, 0, *this));
+
+  this->numTriangles = numTriangles;
+
+  // SAH cost: C_t * sum(SA(interior)) + C_i * sum(|leaf| * SA(leaf)),
+  // normalized by the surface area of the root
+  double rootArea = root ? surfaceArea(root->extent) : 0.0;
+  if (rootArea > 0.0) {
+    sahCost = (sah.m_Ct*interiorArea + sah.m_Ci*leafArea) / rootArea;
+  }
+}
+
+// a packed node waiting to be visited, with its extent
+struct PackedVisit {
+  uint idx, depth;
+  BoundingBox extent;
+};
+
+void TreeQuality::compute(const vector<MantaKDTreeNode> &nodes,
+                          const BoundingBox &rootExtent, const SAH &sah,
+                          uint numTriangles) {
+  compute(nodes.empty() ? NULL : &nodes[0], rootExtent, sah, numTriangles);
+}
+
+void TreeQuality::compute(const MantaKDTreeNode *nodes,
+                          const BoundingBox &rootExtent, const SAH &sah,
+                          uint numTriangles) {
+  if (!nodes) return;
+  vector<PackedVisit> stack;
+  PackedVisit root = { 0, 0, rootExtent };
+  stack.push_back(root);
+  while (!stack.empty()) {
+    PackedVisit v = stack.back();
+    stack.pop_back();
+
+    const MantaKDTreeNode &node = nodes[v.idx];
+    if (node.isLeaf) {
+      addLeaf(node.numPrimitives, v.extent, v.depth);
+      continue;
+    }
+    addInterior(v.extent);
+
+    PackedVisit left = { node.childIdx, v.depth+1, v.extent };
+    left.extent.max[node.planeDim] = node.planePos;
+    PackedVisit right = { (uint)node.childIdx+1, v.depth+1, v.extent };
+    right.extent.min[node.planeDim] = node.planePos;
+    stack.push_back(right);
+    stack.push_back(left);
+  }
+
+  this->numTriangles = numTriangles;
+
+  double rootArea = surfaceArea(rootExtent);
+  if (rootArea > 0.0) {
+    sahCost = (sah.m_Ct*interiorArea + sah.m_Ci*leafArea) / rootArea;
+  }
+}
+
+void TreeQuality::merge(const TreeQuality &other) {
+  interiorArea += other.interiorArea;
+  leafArea += other.leafArea;
+  interiorCount += other.interiorCount;
+  leafCount += other.leafCount;
+  emptyLeafCount += other.emptyLeafCount;
+  if (other.maxLeafSize > maxLeafSize) {
+    maxLeafSize = other.maxLeafSize;
+  }
+  triangleRefs += other.triangleRefs;
+
+  if (other.depthHistogram.size() > depthHistogram.size()) {
+    depthHistogram.resize(other.depthHistogram.size(), 0);
+  }
+  for (uint i=0;i<other.depthHistogram.size();i++) {
+    depthHistogram[i] += other.depthHistogram[i];
+  }
+}
+
+void TreeQuality::addInterior(const KdTreeNode *node) {
+  addInterior(node->extent);
+}
+
+void TreeQuality::addLeaf(const KdTreeNode *node, uint depth) {
+  uint size = (node && node->triangleIndices) ? node->triangleIndices->size() : 0;
+  addLeaf(size, node ? node->extent : BoundingBox(), depth);
+}
+
+void TreeQuality::addInterior(const BoundingBox &extent) {
+  interiorCount++;
+  interiorArea += surfaceArea(extent);
+}
+
+void TreeQuality::addLeaf(uint size, const BoundingBox &extent, uint depth) {
+  leafCount++;
+  if (size == 0) {
+    emptyLeafCount++;
+  } else {
+    leafArea += size*surfaceArea(extent);
+  }
+  if (size > maxLeafSize) {
+    maxLeafSize = size;
+  }
+  triangleRefs += size;
+
+  if (depth >= depthHistogram.size()) {
+    depthHistogram.resize(depth+1, 0);
+  }
+  depthHistogram[depth]++;
+}
+
+float TreeQuality::avgLeafSize() const {
+  uint nonEmpty = leafCount - emptyLeafCount;
+  return nonEmpty ? (float)triangleRefs/nonEmpty : 0.0f;
+}
+
+float TreeQuality::duplicationFactor() const {
+  return numTriangles ? (float)triangleRefs/numTriangles : 0.0f;
+}
+
+uint64 TreeQuality::nodeBytes() const {
+  return (uint64)(interiorCount + leafCount)*sizeof(MantaKDTreeNode);
+}
+
+uint64 TreeQuality::itemBytes() const {
+  return triangleRefs*sizeof(int);
+}
+
+void TreeQuality::print(ostream &out) const {
+  out << "              TREE QUALITY\n\n";
+
+  out << setw(34) << left << "SAH cost" << ": " 
+      << setw(20) << right << sahCost << "\n"
+      << setw(34) << left << "Interior nodes" << ": " 
+      << setw(20) << right << interiorCount << "\n"
+      << setw(34) << left << "Leaves" << ": " 
+      << setw(20) << right << leafCount << "\n"
+      << setw(34) << left << "Empty leaves" << ": " 
+      << setw(20) << right << emptyLeafCount << "\n"
+      << setw(34) << left << "Triangles per leaf (Avg)" << ": " 
+      << setw(20) << right << avgLeafSize() << "\n"
+      << setw(34) << left << "Triangles per leaf (Max)" << ": " 
+      << setw(20) << right << maxLeafSize << "\n"
+      << setw(34) << left << "Triangle references" << ": " 
+      << setw(20) << right << triangleRefs << "\n"
+      << setw(34) << left << "Duplication factor" << ": " 
+      << setw(20) << right << duplicationFactor() << "\n"
+      << setw(34) << left << "Node memory (bytes)" << ": " 
+      << setw(20) << right << nodeBytes() << "\n"
+      << setw(34) << left << "Item memory (bytes)" << ": " 
+      << setw(20) << right << itemBytes() << "\n";
+
+  out << "\n";
+
+  for (uint i=0;i<depthHistogram.size();i++) {
+    char buf[64];
+    sprintf(buf, "Leaves at depth %u", i);
+    out << setw(34) << left << buf << ": " 
+        << setw(20) << right << depthHistogram[i] << "\n";
+  }
+}
+
+void TreeQuality::printCSVHeader(ostream &out, uint maxDepth) {
+  out << ",sah_cost,interior_nodes,leaves,empty_leaves"
+      << ",leaf_size_avg,leaf_size_max,triangle_refs,duplication"
+      << ",node_bytes,item_bytes";
+
+  for (uint i=0;i<=maxDepth;i++) {
+    out << ",leaves_depth_" << i;
+  }
+}
+
+void TreeQuality::printCSV(ostream &out, uint maxDepth) const {
+  out << "," << sahCost
+      << "," << interiorCount
+      << "," << leafCount
+      << "," << emptyLeafCount
+      << "," << avgLeafSize()
+      << "," << maxLeafSize
+      << "," << triangleRefs
+      << "," << duplicationFactor()
+      << "," << nodeBytes()
+      << "," << itemBytes();
+
+  for (uint i=0;i<=maxDepth;i++) {
+    out << "," << (i < depthHistogram.size() ? depthHistogram[i] : 0);
+  }
+}
@@ -0,0 +1,104 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _TREEQUALITY_H_
+#define _TREEQUALITY_H_
+
+#include <iostream>
+#include <vector>
+
+#include "common.h"
+#include "KdTreeNode.h"
+#include "MantaKDTreeNode.h"
+#include "SAH.h"
+
+// Post-build analysis of a finished kd-tree. Walks the tree once (in
+// parallel, see TreeQuality_task) and accumulates everything needed to
+// judge how good the tree is, independent of how long it took to build.
+class TreeQuality {
+public:
+  TreeQuality();
+
+  // analyze the tree rooted at root; numTriangles is the size of the input
+  // mesh (for the duplication factor)
+  void compute(const KdTreeNode *root, const SAH &sah, uint numTriangles);
+  // same for a packed tree; node extents follow from rootExtent and the
+  // split planes
+  void compute(const std::vector<MantaKDTreeNode> &nodes,
+               const BoundingBox &rootExtent, const SAH &sah, uint numTriangles);
+  // same, for nodes that are not in a vector (e.g. mapped from a file)
+  void compute(const MantaKDTreeNode *nodes,
+               const BoundingBox &rootExtent, const SAH &sah, uint numTriangles);
+
+  // fold the partial results of another subtree into this one
+  void merge(const TreeQuality &other);
+
+  // accumulate a single node; a NULL leaf is an empty child
+  void addInterior(const KdTreeNode *node);
+  void addLeaf(const KdTreeNode *node, uint depth);
+  void addInterior(const BoundingBox &extent);
+  void addLeaf(uint size, const BoundingBox &extent, uint depth);
+
+  void print(std::ostream &out) const;
+  static void printCSVHeader(std::ostream &out, uint maxDepth);
+  void printCSV(std::ostream &out, uint maxDepth) const;
+
+  // partial sums, area-weighted (unnormalized) while walking
+  double interiorArea;     // sum of interior node surface areas
+  double leafArea;         // sum of |leaf| * leaf surface area
+
+  // final SAH cost of the tree, relative to the root's surface area
+  double sahCost;
+
+  uint interiorCount;
+  uint leafCount;          // NULL children count as (empty) leaves
+  uint emptyLeafCount;
+  uint maxLeafSize;
+  uint64 triangleRefs;     // sum of leaf sizes
+  uint numTriangles;
+
+  std::vector<uint> depthHistogram; // # of leaves at each depth
+
+  float avgLeafSize() const;
+  float duplicationFactor() const;
+  uint64 nodeBytes() const; // as written by writeToFile()
+  uint64 itemBytes() const;
+};
+
+#endif // _TREEQUALITY_H_
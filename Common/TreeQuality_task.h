@@ -0,0 +1,92 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _TREEQUALITY_TASK_H_
+#define _TREEQUALITY_TASK_H_
+
+#include <tbb/task.h>
+
+#include "TreeQuality.h"
+#include "KdTreeNode.h"
+
+// nodes deeper than this are walked serially by their parent task
+#define TREEQUALITY_SPAWN_DEPTH 8
+
+class TreeQuality_task : public tbb::task {
+public:
+  const KdTreeNode *node;
+  const uint depth;
+  TreeQuality &result;
+
+  TreeQuality_task(const KdTreeNode *node, uint depth, TreeQuality &result)
+    : node(node), depth(depth), result(result) {}
+
+  tbb::task *execute() {
+    if (depth >= TREEQUALITY_SPAWN_DEPTH || 
+        node == NULL || (node->left == NULL && node->right == NULL)) {
+      walk(node, depth, result);
+      return NULL;
+    }
+
+    result.addInterior(node);
+
+    // each child accumulates into its own partial result
+    TreeQuality leftResult, rightResult;
+
+    set_ref_count(3);
+    spawn(*new(allocate_child()) TreeQuality_task(node->left, depth+1, leftResult));
+    spawn_and_wait_for_all(*new(allocate_child()) TreeQuality_task(node->right, depth+1, 
+                                                                   rightResult));
+    result.merge(leftResult);
+    result.merge(rightResult);
+    return NULL;
+  }
+
+  static void walk(const KdTreeNode *node, uint depth, TreeQuality &q) {
+    if (node == NULL || (node->left == NULL && node->right == NULL)) {
+      q.addLeaf(node, depth);
+    } else {
+      q.addInterior(node);
+      walk(node->left, depth+1, q);
+      walk(node->right, depth+1, q);
+    }
+  }
+};
+
+#endif // _TREEQUALITY_TASK_H_
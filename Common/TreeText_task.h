@@ -0,0 +1,179 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _TREETEXT_TASK_H_
+#define _TREETEXT_TASK_H_
+
+#include <stdio.h>
+#include <string>
+#include <ostream>
+#include <vector>
+#include <algorithm>
+
+#include <tbb/task.h>
+
+#include "KdTreeNode.h"
+
+// subtrees below this depth are formatted serially, into one buffer each
+#define TREETEXT_SPAWN_DEPTH 8
+
+enum TreeTextMode {
+  TREETEXT_LIST,          // printTree(): sorted triangles of every node
+  TREETEXT_GRAPHVIZ,      // printGraphviz(): edges labeled with leaf sizes
+  TREETEXT_GRAPHVIZ_ACCM  // printGraphvizAccm(): sizes summed from the root
+};
+
+// Formats a subtree the way the old recursive stream helpers did. Above
+// TREETEXT_SPAWN_DEPTH a node's own text goes to pieces[h] (h numbered
+// like a heap: root 1, children 2h and 2h+1) and its children are
+// formatted concurrently; the pieces are written out in preorder.
+class TreeText_task : public tbb::task {
+public:
+  TreeText_task(const KdTreeNode *node, uint depth, uint h, TreeTextMode mode,
+                uint level, uint accm, std::vector<std::string> &pieces)
+    : node(node), depth(depth), h(h), mode(mode), level(level), accm(accm),
+      pieces(pieces) {}
+
+  tbb::task *execute() {
+    std::string &out = pieces[h];
+    if (depth >= TREETEXT_SPAWN_DEPTH || (node->left == NULL && node->right == NULL)) {
+      walk(node, mode, level, accm, out);
+      return NULL;
+    }
+
+    uint childAccm = formatNode(node, mode, level, accm, out);
+
+    tbb::task_list children;
+    int count = 1;
+    if (node->left) {
+      children.push_back(*new(allocate_child()) TreeText_task(node->left, depth+1, 2*h, mode,
+                                                              level+1, childAccm, pieces));
+      count++;
+    }
+    if (node->right) {
+      children.push_back(*new(allocate_child()) TreeText_task(node->right, depth+1, 2*h+1, mode,
+                                                              level+1, childAccm, pieces));
+      count++;
+    }
+    set_ref_count(count);
+    spawn_and_wait_for_all(children);
+    return NULL;
+  }
+
+  // the pieces of the subtree at h, in output order
+  static void write(const std::vector<std::string> &pieces, uint h,
+                    std::ostream &out) {
+    if (h >= pieces.size()) return;
+    out.write(pieces[h].data(), pieces[h].size());
+    write(pieces, 2*h, out);
+    write(pieces, 2*h+1, out);
+  }
+
+  static void walk(const KdTreeNode *node, TreeTextMode mode, uint level,
+                   uint accm, std::string &out) {
+    uint childAccm = formatNode(node, mode, level, accm, out);
+    if (node->left) walk(node->left, mode, level+1, childAccm, out);
+    if (node->right) walk(node->right, mode, level+1, childAccm, out);
+  }
+
+  static void appendInt(std::string &out, long value) {
+    char buf[24];
+    int len = snprintf(buf, sizeof(buf), "%ld", value);
+    out.append(buf, len);
+  }
+
+  static void appendNode(std::string &out, const KdTreeNode *node) {
+    char buf[24];
+    int len = snprintf(buf, sizeof(buf), "%p", (const void*)node);
+    out += '"';
+    out.append(buf, len);
+    out += '"';
+  }
+
+  static uint size(const KdTreeNode *node) {
+    return node->triangleIndices ? node->triangleIndices->size() : 0;
+  }
+
+private:
+  const KdTreeNode *node;
+  const uint depth, h;
+  const TreeTextMode mode;
+  const uint level, accm;
+  std::vector<std::string> &pieces;
+
+  // the node's own text; returns the accumulated size for its children
+  static uint formatNode(const KdTreeNode *node, TreeTextMode mode, uint level,
+                         uint accm, std::string &out) {
+    if (mode == TREETEXT_LIST) {
+      if (node->triangleIndices) {
+        // sort a copy -- printing leaves the tree alone
+        std::vector<int> sorted(*node->triangleIndices);
+        std::sort(sorted.begin(), sorted.end());
+        for (uint i=0;i<sorted.size();i++) {
+          appendInt(out, sorted[i]);
+          out += ' ';
+        }
+        out += '\n';
+      }
+      return 0;
+    }
+
+    if (mode == TREETEXT_GRAPHVIZ_ACCM) {
+      accm += size(node);
+    }
+    const KdTreeNode *children[2] = { node->left, node->right };
+    for (uint i=0;i<2;i++) {
+      const KdTreeNode *child = children[i];
+      if (!child) continue;
+      appendNode(out, child);
+      out += "[label=\"";
+      appendInt(out, level);
+      out += ": ";
+      appendInt(out, mode == TREETEXT_GRAPHVIZ_ACCM ? accm + size(child) : size(child));
+      out += "\"];";
+      appendNode(out, node);
+      out += " -> ";
+      appendNode(out, child);
+      out += ";\n";
+    }
+    return accm;
+  }
+};
+
+#endif // _TREETEXT_TASK_H_
@@ -58,6 +58,8 @@ public:
   void serialize(std::ostream &out) const;
   void deserialize(std::istream &in);
 
+  const Vec3f &getVertex(int i) const { return vertex[i]; }
+
   BoundingBox bound;
   
 private:
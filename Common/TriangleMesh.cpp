@@ -46,6 +46,7 @@
 
 #include "Triangle.h"
 #include "TriangleMesh.h"
+#include "BoundingBox.h"
 
 using namespace std;
 
@@ -56,11 +57,25 @@ void TriangleMesh::addTriangles(const string & filename) {
   }
 }
 
-void TriangleMesh::addTriangles(istream &in) {
-  Triangle tri;
-  BoundingBox triBound;
+bool TriangleMesh::load(const string &filename) {
+  ifstream in(filename.c_str());
+  if (!in.is_open()) return false;
+
+  string::size_type dot = filename.rfind('.');
+  string suffix = (dot == string::npos) ? "" : filename.substr(dot);
+  if (suffix == ".obj") {
+    addTriangles(in);
+    return true;
+  } else if (suffix == ".blob") {
+    deserialize(in);
+    return !in.fail();
+  }
+  return false;
+}
 
+void TriangleMesh::addTriangles(istream &in) {
   int vcnt_orig = vertexList.size();
+  unsigned int tcnt_orig = numTriangles();
 
   while (!in.eof()) {
     string first;
@@ -106,36 +121,161 @@ void TriangleMesh::addTriangles(istream &in) {
         in.seekg(1, ios::cur);
       }
       
-      tri = Triangle(vertexList[trii[0]+vcnt_orig], 
-                     vertexList[trii[1]+vcnt_orig], 
-                     vertexList[trii[2]+vcnt_orig]);
-      this->triangleList.push_back(tri);
-      this->boundingBox += tri.bound;
+      indexList.push_back(trii[0]+vcnt_orig);
+      indexList.push_back(trii[1]+vcnt_orig);
+      indexList.push_back(trii[2]+vcnt_orig);
     } else {
       continue;
     }
   }
+
+  computeBounds(tcnt_orig);
   
   return;
 }
 
+GeometryView TriangleMesh::view() const {
+  GeometryView geometry;
+  geometry.setBounds(bounds);
+  return geometry;
+}
+
+#define MAX(a, b) ((a) < (b) ? (b) : (a))
+#define MAX3(a, b, c) MAX( MAX(a ,b) ,c)
+#define MIN(a, b) ((a) > (b) ? (b) : (a))
+#define MIN3(a, b, c) MIN( MIN(a, b) ,c)
+
+void TriangleMesh::computeBounds(unsigned int begin) {
+  unsigned int n = numTriangles();
+  bounds.resize(n);
+
+  for (unsigned int i=begin;i<n;i++) {
+    const Vec3f &v0 = vertexList[indexList[3*i+0]];
+    const Vec3f &v1 = vertexList[indexList[3*i+1]];
+    const Vec3f &v2 = vertexList[indexList[3*i+2]];
+
+    BoundingBox triBound;
+    for (int axis=0;axis<3;axis++) {
+      triBound.min[axis] = bounds.min[axis][i] = MIN3(v0[axis], v1[axis], v2[axis]);
+      triBound.max[axis] = bounds.max[axis][i] = MAX3(v0[axis], v1[axis], v2[axis]);
+    }
+    boundingBox += triBound;
+  }
+}
+
+// Blob layout (indexed):
+//   int magic, uint #vertices, Vec3f[], uint #triangles, uint[3*#triangles],
+//   BoundingBox
+// Older blobs start with a non-negative triangle count followed by whole
+// Triangle objects; deserialize() still reads those.
+const int TriangleMesh::BLOB_INDEXED_MAGIC;
+
 void TriangleMesh::serialize(std::ostream &out) const {
-  int size = triangleList.size();
-  out.write((char*)&size, sizeof(int));
+  out.write((char*)&BLOB_INDEXED_MAGIC, sizeof(int));
+
+  unsigned int nv = vertexList.size();
+  unsigned int nt = numTriangles();
 
   // Relying on STL vector's guarantee on data layout (continuity)
-  out.write((char*)&triangleList[0], sizeof(triangleList[0])*size);
+  out.write((char*)&nv, sizeof(nv));
+  if (nv) out.write((char*)&vertexList[0], sizeof(vertexList[0])*nv);
+  out.write((char*)&nt, sizeof(nt));
+  if (nt) out.write((char*)&indexList[0], sizeof(indexList[0])*3*nt);
 
   boundingBox.serialize(out);
 }
 
+// bytes left in the stream, or as many as a size_t holds if it can't seek
+static size_t bytesLeft(std::istream &in) {
+  std::istream::pos_type here = in.tellg();
+  if (here == std::istream::pos_type(-1)) {
+    in.clear();
+    return (size_t)-1;
+  }
+  in.seekg(0, ios::end);
+  std::istream::pos_type end = in.tellg();
+  in.seekg(here);
+  if (end == std::istream::pos_type(-1) || end < here) {
+    in.clear();
+    in.seekg(here);
+    return (size_t)-1;
+  }
+  return end - here;
+}
+
+// Counts come from the blob itself, so they are checked against what is
+// left of it before anything is allocated; a bad blob leaves the stream
+// failed (and the mesh to be thrown away) rather than taking the process
+// down.
 void TriangleMesh::deserialize(std::istream &in) {
-  int size;
-  in.read((char*)&size, sizeof(int));
-  triangleList.resize(size);
+  int magic;
+  in.read((char*)&magic, sizeof(int));
+  if (!in) return;
+  if (magic >= 0) {
+    deserializeLegacy(in, magic);
+    return;
+  }
+
+  unsigned int nv, nt;
 
   // Relying on STL vector's guarantee on data layout (continuity)
-  in.read((char*)&triangleList[0], sizeof(triangleList[0])*size);
+  in.read((char*)&nv, sizeof(nv));
+  if (!in || nv > bytesLeft(in)/sizeof(vertexList[0])) {
+    in.setstate(ios::failbit);
+    return;
+  }
+  vertexList.resize(nv);
+  if (nv) in.read((char*)&vertexList[0], sizeof(vertexList[0])*nv);
+  in.read((char*)&nt, sizeof(nt));
+  if (!in || (size_t)nt > bytesLeft(in)/(3*sizeof(indexList[0]))) {
+    in.setstate(ios::failbit);
+    return;
+  }
+  indexList.resize(3*(size_t)nt);
+  if (nt) in.read((char*)&indexList[0], sizeof(indexList[0])*3*(size_t)nt);
+
+  boundingBox.deserialize(in);
+  if (!in) return;
+
+  // computeBounds() looks the vertices up
+  for (size_t i=0;i<indexList.size();i++) {
+    if (indexList[i] >= nv) {
+      in.setstate(ios::failbit);
+      return;
+    }
+  }
+  computeBounds(0);
+}
+
+void TriangleMesh::deserializeLegacy(std::istream &in, int size) {
+  const int CHUNK = 4096;
+  if ((size_t)size > bytesLeft(in)/sizeof(Triangle)) {
+    in.setstate(ios::failbit);
+    return;
+  }
+  vector<Triangle> chunk(CHUNK);
+
+  vertexList.resize(3*(size_t)size);
+  indexList.resize(3*(size_t)size);
+  bounds.resize(size);
+
+  // no sharing information in the old format - every triangle gets its
+  // own three vertices
+  for (int i=0;i<size;i+=CHUNK) {
+    int cnt = MIN(CHUNK, size-i);
+    in.read((char*)&chunk[0], sizeof(chunk[0])*cnt);
+
+    for (int j=0;j<cnt;j++) {
+      for (int k=0;k<3;k++) {
+        indexList[3*(i+j)+k] = 3*(i+j)+k;
+        vertexList[3*(i+j)+k] = chunk[j].getVertex(k);
+      }
+      for (int axis=0;axis<3;axis++) {
+        bounds.min[axis][i+j] = chunk[j].bound.min[axis];
+        bounds.max[axis][i+j] = chunk[j].bound.max[axis];
+      }
+    }
+  }
 
   boundingBox.deserialize(in);
 }
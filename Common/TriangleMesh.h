@@ -46,21 +46,42 @@
 
 #include "Vec3f.h"
 #include "Triangle.h"
+#include "TriangleBounds.h"
+#include "GeometryView.h"
 
+// Indexed triangle mesh -- vertices are shared among triangles, and each
+// triangle is three indices into vertexList. The builders only ever look at
+// the per-triangle bounds, which are kept separately in SoA form.
 class TriangleMesh {
 public:
   void addTriangles(std::istream &in);
   void addTriangles(const std::string &filename);
+  // .obj or .blob, by suffix; false if the file could not be read
+  bool load(const std::string &filename);
+
+  unsigned int numTriangles() const { return indexList.size()/3; }
+
+  // what the builders read; valid until the mesh is modified
+  GeometryView view() const;
+
+  // first int of an indexed .blob (see TriangleMesh.cpp for the layout)
+  static const int BLOB_INDEXED_MAGIC = -2;
   
   // Object serialization
   void serialize(std::ostream &out) const;
   void deserialize(std::istream &in);
 
-  std::vector<Triangle> triangleList;
+  std::vector<Vec3f> vertexList;
+  std::vector<unsigned int> indexList; // [ v0, v1, v2 ] per triangle
+  TriangleBounds bounds;
   BoundingBox boundingBox;
 
 private:
-  std::vector<Vec3f> vertexList;
+  // compute bounds of triangles [begin, numTriangles()) and grow boundingBox
+  void computeBounds(unsigned int begin);
+
+  // pre-indexed .blob files: array of whole Triangle objects
+  void deserializeLegacy(std::istream &in, int size);
 };
 
 #endif // _TRIANGLE_MESH_H_
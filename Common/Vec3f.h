@@ -55,6 +55,11 @@ public:
     return m_values[_i];
   }
 
+  inline float operator[](size_t _i) const {
+    assert(_i<3);
+    return m_values[_i];
+  }
+
 private:
   float m_values[3];
 };
@@ -60,5 +60,7 @@ __inline long int getTime() {
   return tv.tv_sec * 1000000 + tv.tv_usec;
 }
 
-#define RECORD_TIME(seconds, ticks) {if(g_time_in_ticks) ticks = rdtsc(); else seconds = getTime();}
+// Both clocks are sampled; BuildOptions::timeInTicks only picks the one that
+// gets reported.
+#define RECORD_TIME(seconds, ticks) {ticks = rdtsc(); seconds = getTime();}
 #endif
@@ -0,0 +1,403 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <climits>
+#include <string>
+#include <vector>
+
+#include "TriangleMesh.h"
+
+using namespace std;
+
+// Deterministic generator (splitmix64). rand() differs between C libraries,
+// and a seeded scene has to come out bit-identical on every machine.
+class Random {
+public:
+  Random(unsigned long long seed) : m_state(seed) {}
+
+  unsigned long long next() {
+    unsigned long long z = (m_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  // [0, 1) with 24 bits of precision
+  float uniform() { return (next() >> 40) * (1.0f / 16777216.0f); }
+  float uniform(float lo, float hi) { return lo + (hi - lo) * uniform(); }
+
+private:
+  unsigned long long m_state;
+};
+
+// Streams an indexed .blob (same layout as TriangleMesh::serialize) without
+// ever holding the mesh in memory. The counts come first, so each scene
+// works out its vertex and triangle counts up front; the bounding box comes
+// last and is accumulated as the vertices go by.
+class BlobWriter {
+public:
+  BlobWriter(ostream &out) : m_out(out), m_nv(0), m_nt(0), m_vcount(0),
+                             m_tcount(0) {
+    m_vbuf.reserve(CHUNK*3);
+    m_ibuf.reserve(CHUNK*3);
+  }
+
+  void beginVertices(unsigned int nv) {
+    m_nv = nv;
+    m_out.write((char*)&TriangleMesh::BLOB_INDEXED_MAGIC, sizeof(int));
+    m_out.write((char*)&nv, sizeof(nv));
+  }
+
+  void vertex(float x, float y, float z) {
+    if (x < m_box.min[0]) m_box.min[0] = x;
+    if (x > m_box.max[0]) m_box.max[0] = x;
+    if (y < m_box.min[1]) m_box.min[1] = y;
+    if (y > m_box.max[1]) m_box.max[1] = y;
+    if (z < m_box.min[2]) m_box.min[2] = z;
+    if (z > m_box.max[2]) m_box.max[2] = z;
+
+    m_vbuf.push_back(x);
+    m_vbuf.push_back(y);
+    m_vbuf.push_back(z);
+    if (m_vbuf.size() >= CHUNK*3) flush(m_vbuf);
+    m_vcount++;
+  }
+
+  void vertex(const float *v) { vertex(v[0], v[1], v[2]); }
+
+  void beginTriangles(unsigned int nt) {
+    check(m_vcount, m_nv, "vertices");
+    flush(m_vbuf);
+    m_nt = nt;
+    m_out.write((char*)&nt, sizeof(nt));
+  }
+
+  void triangle(unsigned int a, unsigned int b, unsigned int c) {
+    m_ibuf.push_back(a);
+    m_ibuf.push_back(b);
+    m_ibuf.push_back(c);
+    if (m_ibuf.size() >= CHUNK*3) flush(m_ibuf);
+    m_tcount++;
+  }
+
+  void finish() {
+    check(m_tcount, m_nt, "triangles");
+    flush(m_ibuf);
+    m_box.serialize(m_out);
+  }
+
+private:
+  static const size_t CHUNK = 1 << 16;
+
+  template<typename T>
+  void flush(vector<T> &buf) {
+    if (!buf.empty()) m_out.write((char*)&buf[0], sizeof(T)*buf.size());
+    buf.clear();
+  }
+
+  void check(unsigned int written, unsigned int declared, const char *what) {
+    if (written != declared) {
+      cerr << "generator: wrote " << written << " " << what << ", declared "
+           << declared << endl;
+      exit(1);
+    }
+  }
+
+  ostream &m_out;
+  BoundingBox m_box;
+  unsigned int m_nv, m_nt, m_vcount, m_tcount;
+  vector<float> m_vbuf;
+  vector<unsigned int> m_ibuf;
+};
+
+// Triangle soups write three unshared vertices per triangle, in order
+static void soupIndices(BlobWriter &w, unsigned int n) {
+  w.beginTriangles(n);
+  for (unsigned int t = 0; t < n; t++) {
+    w.triangle(3*t, 3*t+1, 3*t+2);
+  }
+}
+
+// Small triangle around (cx,cy,cz) with vertices within +-h on each axis
+static void smallTriangle(BlobWriter &w, Random &rng,
+                          float cx, float cy, float cz, float h) {
+  for (int k = 0; k < 3; k++) {
+    w.vertex(cx + rng.uniform(-h, h),
+             cy + rng.uniform(-h, h),
+             cz + rng.uniform(-h, h));
+  }
+}
+
+// n small triangles scattered uniformly over the unit cube
+static void genUniform(BlobWriter &w, Random &rng, unsigned int n) {
+  float h = 0.5f / pow((double)n, 1.0/3.0);
+
+  w.beginVertices(3*n);
+  for (unsigned int t = 0; t < n; t++) {
+    float cx = rng.uniform(), cy = rng.uniform(), cz = rng.uniform();
+    smallTriangle(w, rng, cx, cy, cz, h);
+  }
+  soupIndices(w, n);
+}
+
+// "Teapot in a stadium": 1% of the triangles are large and tile the floor
+// and walls of a 200x50x200 open box; the rest are tiny and packed into a
+// unit ball in the middle of the floor.
+static void genStadium(BlobWriter &w, Random &rng, unsigned int n) {
+  const float side = 100.0f, height = 50.0f;
+  unsigned int nStadium = n / 100;
+  unsigned int nCluster = n - nStadium;
+  float area = 4*side*side + 4*(2*side*height);
+  float s = nStadium ? 0.5f * sqrt(area / nStadium) : 0.0f;
+  float h = nCluster ? 0.5f / pow((double)nCluster, 1.0/3.0) : 0.0f;
+
+  w.beginVertices(3*n);
+  for (unsigned int t = 0; t < nStadium; t++) {
+    float p[3];
+    int a0, a1;
+    int face = rng.next() % 5;
+    if (face == 0) { // floor
+      p[0] = rng.uniform(-side, side);
+      p[1] = 0.0f;
+      p[2] = rng.uniform(-side, side);
+      a0 = 0; a1 = 2;
+    } else { // walls
+      int axis = (face < 3) ? 0 : 2;
+      int other = 2 - axis;
+      p[axis] = (face & 1) ? -side : side;
+      p[1] = rng.uniform(0.0f, height);
+      p[other] = rng.uniform(-side, side);
+      a0 = 1; a1 = other;
+    }
+    for (int k = 0; k < 3; k++) {
+      float v[3] = { p[0], p[1], p[2] };
+      v[a0] += rng.uniform(-s, s);
+      v[a1] += rng.uniform(-s, s);
+      w.vertex(v);
+    }
+  }
+  for (unsigned int t = 0; t < nCluster; t++) {
+    float x, y, z;
+    do {
+      x = rng.uniform(-1.0f, 1.0f);
+      y = rng.uniform(-1.0f, 1.0f);
+      z = rng.uniform(-1.0f, 1.0f);
+    } while (x*x + y*y + z*z > 1.0f);
+    smallTriangle(w, rng, x, y + 1.0f, z, h);
+  }
+  soupIndices(w, n);
+}
+
+// Long skinny triangles, each spanning half to all of the unit cube along
+// a random axis -- nearly every split plane cuts through most of them.
+static void genStraddlers(BlobWriter &w, Random &rng, unsigned int n) {
+  const float width = 1e-3f;
+
+  w.beginVertices(3*n);
+  for (unsigned int t = 0; t < n; t++) {
+    int axis = rng.next() % 3;
+    int across = (axis + 1 + rng.next() % 2) % 3;
+    float len = rng.uniform(0.5f, 1.0f);
+    float p[3] = { rng.uniform(), rng.uniform(), rng.uniform() };
+    p[axis] = rng.uniform(0.0f, 1.0f - len);
+
+    w.vertex(p);
+    p[axis] += len;
+    w.vertex(p);
+    p[across] += width;
+    w.vertex(p);
+  }
+  soupIndices(w, n);
+}
+
+// Height field over the unit square, k x k quads as 2*k^2 triangles with
+// shared vertices. k is rounded up, so the count is at least n.
+static void genGrid(BlobWriter &w, Random &rng, unsigned int n) {
+  unsigned int k = (unsigned int)ceil(sqrt(n / 2.0));
+  if (k < 1) k = 1;
+  unsigned int row = k + 1;
+  float cell = 1.0f / k;
+  float phase = rng.uniform(0.0f, 6.2831853f);
+
+  w.beginVertices(row*row);
+  for (unsigned int i = 0; i <= k; i++) {
+    for (unsigned int j = 0; j <= k; j++) {
+      float x = i * cell, z = j * cell;
+      float y = 0.05f * sin(12.566371f * x + phase) * cos(12.566371f * z)
+              + 0.25f * cell * rng.uniform(-1.0f, 1.0f);
+      w.vertex(x, y, z);
+    }
+  }
+
+  w.beginTriangles(2*k*k);
+  for (unsigned int i = 0; i < k; i++) {
+    for (unsigned int j = 0; j < k; j++) {
+      unsigned int v = i*row + j;
+      w.triangle(v, v + 1, v + row + 1);
+      w.triangle(v, v + row + 1, v + row);
+    }
+  }
+}
+
+// Unit UV sphere with t stacks and 2t slices (4t(t-1) triangles, t rounded
+// up so the count is at least n); radii are jittered by up to 1%.
+static void genSphere(BlobWriter &w, Random &rng, unsigned int n) {
+  unsigned int stacks = (unsigned int)ceil(sqrt(n / 4.0)) + 1;
+  if (stacks < 2) stacks = 2;
+  unsigned int slices = 2 * stacks;
+  unsigned int rings = stacks - 1;
+  unsigned int nv = 2 + rings * slices;
+  unsigned int south = nv - 1;
+
+  w.beginVertices(nv);
+  w.vertex(0.0f, 1.0f, 0.0f);
+  for (unsigned int r = 0; r < rings; r++) {
+    double theta = M_PI * (r + 1) / stacks;
+    for (unsigned int j = 0; j < slices; j++) {
+      double phi = 2.0 * M_PI * j / slices;
+      float radius = 1.0f + rng.uniform(-0.01f, 0.01f);
+      w.vertex(radius * sin(theta) * cos(phi),
+               radius * cos(theta),
+               radius * sin(theta) * sin(phi));
+    }
+  }
+  w.vertex(0.0f, -1.0f, 0.0f);
+
+  w.beginTriangles(2 * slices * rings);
+  for (unsigned int j = 0; j < slices; j++) {
+    unsigned int jn = (j + 1) % slices;
+    w.triangle(0, 1 + j, 1 + jn);
+  }
+  for (unsigned int r = 0; r + 1 < rings; r++) {
+    unsigned int a = 1 + r * slices, b = a + slices;
+    for (unsigned int j = 0; j < slices; j++) {
+      unsigned int jn = (j + 1) % slices;
+      w.triangle(a + j, b + j, b + jn);
+      w.triangle(a + j, b + jn, a + jn);
+    }
+  }
+  unsigned int last = 1 + (rings - 1) * slices;
+  for (unsigned int j = 0; j < slices; j++) {
+    unsigned int jn = (j + 1) % slices;
+    w.triangle(last + j, south, last + jn);
+  }
+}
+
+void usage() {
+  string usage[] = {
+    "Usage: ./generator [options] > output.blob",
+    "",
+    "Writes a deterministic synthetic scene as an indexed .blob.",
+    "",
+    "  -d <scene>   uniform | stadium | straddlers | grid | sphere",
+    "               (default: uniform)",
+    "  -n <count>   number of triangles, K/M suffixes allowed (default: 100K)",
+    "               grid and sphere round up to the next full tessellation",
+    "  -s <seed>    random seed (default: 1)",
+    "  -h           this help",
+    "==="
+  };
+
+  int i=0;
+  while(usage[i] != "===") {
+      cout << usage[i++] << endl;
+  }
+
+  exit(0);
+}
+
+// "10K" -> 10000, "2M" -> 2000000
+static unsigned long long parseCount(const char *str) {
+  char *end;
+  unsigned long long n = strtoull(str, &end, 10);
+  if (*end == 'K' || *end == 'k') { n *= 1000ULL; end++; }
+  else if (*end == 'M' || *end == 'm') { n *= 1000000ULL; end++; }
+  return (*end == '\0') ? n : 0;
+}
+
+int main(int argc, char *argv[]) {
+  string scene = "uniform";
+  unsigned long long n = 100000;
+  unsigned long long seed = 1;
+
+  for (unsigned int i=1;i<argc;i++) {
+    if (!strcmp(argv[i], "-h")) {
+      usage();
+    } else if (!strcmp(argv[i], "-d")) {
+      if (++i >= argc) usage();
+      scene = argv[i];
+    } else if (!strcmp(argv[i], "-n")) {
+      if (++i >= argc) usage();
+      n = parseCount(argv[i]);
+    } else if (!strcmp(argv[i], "-s")) {
+      if (++i >= argc) usage();
+      seed = strtoull(argv[i], NULL, 10);
+    } else {
+      usage();
+    }
+  }
+
+  // soups store 3 vertices per triangle; keep every index in 32 bits
+  if (n < 1 || n > UINT_MAX / 3) {
+    cerr << "generator: triangle count must be between 1 and "
+         << UINT_MAX / 3 << endl;
+    exit(1);
+  }
+
+  void (*generate)(BlobWriter &, Random &, unsigned int) = NULL;
+  if (scene == "uniform") generate = genUniform;
+  else if (scene == "stadium") generate = genStadium;
+  else if (scene == "straddlers") generate = genStraddlers;
+  else if (scene == "grid") generate = genGrid;
+  else if (scene == "sphere") generate = genSphere;
+  else usage();
+
+  ofstream ofs("/dev/stdout", fstream::binary);
+  BlobWriter writer(ofs);
+  Random rng(seed);
+
+  generate(writer, rng, n);
+  writer.finish();
+
+  ofs.close();
+}
@@ -37,10 +37,24 @@
    SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
 */
 
-#ifndef _OPTIONS_H_
-#define _OPTIONS_H_
-extern bool g_verbose;
-extern bool g_time_in_ticks;
-extern bool g_superfluous_prescans;
+#ifndef _BATCHBUILD_TASK_H_
+#define _BATCHBUILD_TASK_H_
 
-#endif // _OPTIONS_H_
+#include <tbb/task.h>
+
+#include "BatchBuilder.h"
+
+// one of BatchBuilder's mesh loops
+class BatchBuild_task : public tbb::task {
+public:
+  BatchBuilder &batch;
+
+  BatchBuild_task(BatchBuilder &batch) : batch(batch) {}
+
+  tbb::task *execute() {
+    batch.buildNext();
+    return NULL;
+  }
+};
+
+#endif // _BATCHBUILD_TASK_H_
@@ -0,0 +1,131 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include <tbb/task.h>
+
+#include "BatchBuilder.h"
+#include "BatchBuild_task.h"
+#include "TriangleMesh.h"
+#include "timers.h"
+
+// Interface header -- every implementation has this file!
+#include "KdTreeAccel.h"
+
+using namespace std;
+using namespace tbb;
+
+BatchBuilder::BatchBuilder(const BuildOptions &options, bool quiet)
+  : m_options(options), m_quiet(quiet) {
+  m_next = 0;
+}
+
+void BatchBuilder::add(const string &meshPath) {
+  Item item;
+  item.path = meshPath;
+  item.ok = false;
+
+  struct stat st;
+  item.bytes = (stat(meshPath.c_str(), &st) == 0) ? st.st_size : 0;
+  m_items.push_back(item);
+}
+
+bool BatchBuilder::run(KdTreeBuilder &builder) {
+  // largest first, so the longest builds don't start last
+  stable_sort(m_items.begin(), m_items.end());
+  m_next = 0;
+
+  uint loops = min((size_t)builder.numThreads(), m_items.size());
+  empty_task &root = *new(task::allocate_root()) empty_task;
+  root.set_ref_count(loops+1);
+  task_list list;
+  for (uint i=0;i<loops;i++) {
+    list.push_back(*new(root.allocate_child()) BatchBuild_task(*this));
+  }
+  root.spawn_and_wait_for_all(list);
+  root.destroy(root);
+
+  bool ok = true;
+  for (uint i=0;i<m_items.size();i++) {
+    ok = ok && m_items[i].ok;
+  }
+  return ok;
+}
+
+void BatchBuilder::buildNext() {
+  for (;;) {
+    uint i = m_next++;
+    if (i >= m_items.size()) return;
+    build(m_items[i]);
+  }
+}
+
+void BatchBuilder::build(Item &item) {
+  ostringstream log;
+  long int start_usec = getTime();
+
+  TriangleMesh mesh;
+  if (!mesh.load(item.path)) {
+    log << item.path << " : cannot load\n";
+  } else if (mesh.numTriangles() == 0) {
+    log << item.path << " : no triangles\n";
+  } else {
+    // the builder's pool is already up; the accel runs on it nested
+    KdTreeAccel *accel = new KdTreeAccel(mesh.view(), m_options);
+    accel->build();
+
+    string out = item.path + ".kdtree";
+    item.ok = accel->writeToFile(out.c_str());
+    delete accel;
+
+    log << item.path << " : " << mesh.numTriangles() << " triangles, "
+        << (getTime() - start_usec) << " us";
+    if (item.ok) log << " -> " << out << "\n";
+    else log << ", could not write " << out << "\n";
+  }
+
+  if (!m_quiet || !item.ok) {
+    cerr << log.str();
+  }
+}
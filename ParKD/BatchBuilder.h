@@ -0,0 +1,87 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _BATCHBUILDER_H_
+#define _BATCHBUILDER_H_
+
+#include <string>
+#include <vector>
+
+#include <tbb/atomic.h>
+
+#include "BuildOptions.h"
+#include "KdTreeBuilder.h"
+
+// Builds a separate tree for each of many meshes in one process (parkd
+// --batch), writing each as <mesh>.kdtree in writeToFile()'s layout.
+//
+// As many mesh loops as there are pool threads each take the next mesh
+// off a list sorted by file size, largest first, then load, build, write
+// and free it. A build's own tasks are on the same scheduler, so threads
+// that run out of meshes help with the big builds still going.
+class BatchBuilder {
+public:
+  BatchBuilder(const BuildOptions &options, bool quiet);
+
+  void add(const std::string &meshPath);
+
+  // build everything on builder's pool; false if any mesh failed
+  bool run(KdTreeBuilder &builder);
+
+  // one mesh loop (see BatchBuild_task)
+  void buildNext();
+
+private:
+  struct Item {
+    std::string path;
+    long long bytes; // stand-in for the mesh size until it is loaded
+    bool ok;
+
+    bool operator<(const Item &rhs) const { return bytes > rhs.bytes; }
+  };
+
+  void build(Item &item);
+
+  const BuildOptions m_options;
+  const bool m_quiet;
+  std::vector<Item> m_items;
+  tbb::atomic<uint> m_next;
+};
+
+#endif // _BATCHBUILDER_H_
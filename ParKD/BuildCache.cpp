@@ -0,0 +1,332 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include "BuildCache.h"
+#include "KdTreeAccel_base.h"
+
+using namespace std;
+
+namespace {
+
+// triangles per hash chunk; fixed, so the key doesn't depend on how the
+// chunks are spread over threads
+const uint HASH_CHUNK = 4096;
+
+const uint64 FNV_BASIS = 14695981039346656037ULL;
+const uint64 FNV_PRIME = 1099511628211ULL;
+
+// the second lane, independent of FNV: a multiply-xorshift mix
+inline uint64 mix(uint64 h, uint64 word) {
+  h = (h ^ word) * 0x9E3779B97F4A7C15ULL;
+  return h ^ (h >> 29);
+}
+
+inline uint bits(float f) {
+  uint u;
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+// both lanes of each chunk of the triangles' bounds
+class HashChunks {
+public:
+  HashChunks(const GeometryView &geometry, vector<uint64> &lanes)
+    : m_geometry(geometry), m_lanes(lanes) { }
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    for (uint c=range.begin();c!=range.end();c++) {
+      uint64 a = FNV_BASIS, b = 0;
+      uint end = min(m_geometry.numTriangles(), (c + 1) * HASH_CHUNK);
+      for (uint i=c*HASH_CHUNK;i<end;i++) {
+        for (uint axis=0;axis<3;axis++) {
+          float lo, hi;
+          m_geometry.bounds(axis, i, lo, hi);
+          a = (a ^ bits(lo)) * FNV_PRIME;
+          a = (a ^ bits(hi)) * FNV_PRIME;
+          b = mix(b, bits(lo));
+          b = mix(b, bits(hi));
+        }
+      }
+      m_lanes[2*c] = a;
+      m_lanes[2*c + 1] = b;
+    }
+  }
+
+private:
+  const GeometryView &m_geometry;
+  vector<uint64> &m_lanes;
+};
+
+struct Entry {
+  string path;
+  uint64 bytes;
+  struct timespec used;
+
+  bool operator<(const Entry &rhs) const {
+    if (used.tv_sec != rhs.used.tv_sec) return used.tv_sec < rhs.used.tv_sec;
+    return used.tv_nsec < rhs.used.tv_nsec;
+  }
+};
+
+bool endsWith(const string &s, const string &suffix) {
+  return s.size() >= suffix.size() &&
+    s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// the trees in dir, least recently used first
+vector<Entry> listEntries(const string &dir) {
+  vector<Entry> entries;
+  DIR *d = opendir(dir.c_str());
+  if (!d) return entries;
+  while (struct dirent *e = readdir(d)) {
+    string name(e->d_name);
+    if (name[0] == '.' || !endsWith(name, ".kdtree")) continue;
+    Entry entry;
+    entry.path = dir + "/" + name;
+    struct stat st;
+    if (stat(entry.path.c_str(), &st) != 0) continue;
+    entry.bytes = st.st_size;
+    entry.used = st.st_mtim;
+    entries.push_back(entry);
+  }
+  closedir(d);
+  sort(entries.begin(), entries.end());
+  return entries;
+}
+
+} // namespace
+
+BuildCache::BuildCache(const string &dir, uint64 maxBytes)
+  : m_dir(dir), m_maxBytes(maxBytes), m_mapped(NULL), m_mappedBytes(0),
+    m_items(NULL), m_numItems(0), m_nodes(NULL), m_numNodes(0) {
+}
+
+BuildCache::~BuildCache() {
+  unmap();
+}
+
+string BuildCache::key(const GeometryView &geometry,
+                       const BuildOptions &options, const string &impl) {
+  uint chunks = (geometry.numTriangles() + HASH_CHUNK - 1) / HASH_CHUNK;
+  vector<uint64> lanes(2*chunks);
+  tbb::parallel_for(tbb::blocked_range<uint>(0, chunks),
+                    HashChunks(geometry, lanes));
+
+  uint64 a = FNV_BASIS, b = 0;
+  for (uint c=0;c<chunks;c++) {
+    a = (a ^ lanes[2*c]) * FNV_PRIME;
+    b = mix(b, lanes[2*c + 1]);
+  }
+
+  // what else decides the tree
+  uint params[] = { geometry.numTriangles(), options.maxDepth,
+                    bits(options.Ct), bits(options.Ci),
+                    bits(options.emptyBonus), options.deterministic };
+  for (uint i=0;i<sizeof(params)/sizeof(params[0]);i++) {
+    a = (a ^ params[i]) * FNV_PRIME;
+    b = mix(b, params[i]);
+  }
+  for (uint i=0;i<impl.size();i++) {
+    a = (a ^ (unsigned char)impl[i]) * FNV_PRIME;
+    b = mix(b, (unsigned char)impl[i]);
+  }
+
+  char hex[33];
+  sprintf(hex, "%016llx%016llx", a, b);
+  return string(hex);
+}
+
+string BuildCache::path(const string &key) const {
+  return m_dir + "/" + key + ".kdtree";
+}
+
+void BuildCache::unmap() {
+  if (m_mapped) munmap(m_mapped, m_mappedBytes);
+  m_mapped = NULL;
+  m_mappedBytes = 0;
+  m_items = NULL;
+  m_numItems = 0;
+  m_nodes = NULL;
+  m_numNodes = 0;
+}
+
+bool BuildCache::lookup(const string &key) {
+  unmap();
+  string file = path(key);
+  int fd = open(file.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < 2*sizeof(uint)) {
+    if (fd >= 0) close(fd);
+    count(0, 1, 0);
+    return false;
+  }
+  void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    count(0, 1, 0);
+    return false;
+  }
+
+  // same layout as writeToFile(); a file that doesn't add up is a miss
+  const char *in = (const char *)mapped;
+  uint64 size = st.st_size;
+  uint numItems, numNodes;
+  memcpy(&numItems, in, sizeof(numItems));
+  uint64 nodesAt = sizeof(uint) + (uint64)numItems*sizeof(int);
+  bool ok = nodesAt + sizeof(uint) <= size;
+  if (ok) {
+    memcpy(&numNodes, in + nodesAt, sizeof(numNodes));
+    ok = nodesAt + sizeof(uint) +
+      (uint64)numNodes*sizeof(MantaKDTreeNode) == size && numNodes > 0;
+  }
+  if (!ok) {
+    munmap(mapped, st.st_size);
+    count(0, 1, 0);
+    return false;
+  }
+
+  m_mapped = mapped;
+  m_mappedBytes = st.st_size;
+  m_items = (const int *)(in + sizeof(uint));
+  m_numItems = numItems;
+  m_nodes = (const MantaKDTreeNode *)(in + nodesAt + sizeof(uint));
+  m_numNodes = numNodes;
+
+  // most recently used now
+  utimes(file.c_str(), NULL);
+  count(1, 0, 0);
+  return true;
+}
+
+bool BuildCache::store(const string &key, const vector<int> &items,
+                       const vector<MantaKDTreeNode> &nodes) {
+  char suffix[32];
+  sprintf(suffix, ".%d.tmp", (int)getpid());
+  string temp = m_dir + "/." + key + suffix;
+  if (!KdTreeAccel_base::writeToFile(temp.c_str(), items, nodes) ||
+      rename(temp.c_str(), path(key).c_str()) != 0) {
+    cerr << "Could not store the tree in " << m_dir << ": "
+         << strerror(errno) << "\n";
+    unlink(temp.c_str());
+    return false;
+  }
+  evict();
+  return true;
+}
+
+void BuildCache::evict() {
+  vector<Entry> entries = listEntries(m_dir);
+  uint64 total = 0;
+  for (uint i=0;i<entries.size();i++) {
+    total += entries[i].bytes;
+  }
+
+  // the most recent one stays even if it alone is over the limit
+  uint64 evicted = 0;
+  for (uint i=0;i+1<entries.size() && total > m_maxBytes;i++) {
+    // another run may have got there first
+    if (unlink(entries[i].path.c_str()) == 0) {
+      evicted++;
+    }
+    total -= entries[i].bytes;
+  }
+  if (evicted) count(0, 0, evicted);
+}
+
+void BuildCache::count(uint64 hits, uint64 misses, uint64 evictions) const {
+  string file = m_dir + "/stats";
+  int fd = open(file.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return;
+  flock(fd, LOCK_EX);
+
+  char buf[256];
+  ssize_t cnt = pread(fd, buf, sizeof(buf) - 1, 0);
+  buf[cnt > 0 ? cnt : 0] = '\0';
+  uint64 h = 0, m = 0, e = 0;
+  sscanf(buf, "hits %llu misses %llu evictions %llu", &h, &m, &e);
+
+  int len = sprintf(buf, "hits %llu\nmisses %llu\nevictions %llu\n",
+                    h + hits, m + misses, e + evictions);
+  if (ftruncate(fd, 0) == 0) {
+    pwrite(fd, buf, len, 0);
+  }
+  close(fd); // drops the lock
+}
+
+BuildCache::Stats BuildCache::stats() const {
+  Stats stats;
+  stats.hits = stats.misses = stats.evictions = 0;
+
+  string file = m_dir + "/stats";
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    flock(fd, LOCK_SH);
+    char buf[256];
+    ssize_t cnt = pread(fd, buf, sizeof(buf) - 1, 0);
+    buf[cnt > 0 ? cnt : 0] = '\0';
+    sscanf(buf, "hits %llu misses %llu evictions %llu",
+           &stats.hits, &stats.misses, &stats.evictions);
+    close(fd);
+  }
+
+  vector<Entry> entries = listEntries(m_dir);
+  stats.entries = entries.size();
+  stats.bytes = 0;
+  for (uint i=0;i<entries.size();i++) {
+    stats.bytes += entries[i].bytes;
+  }
+  return stats;
+}
@@ -0,0 +1,114 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _BUILDCACHE_H_
+#define _BUILDCACHE_H_
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "BuildOptions.h"
+#include "GeometryView.h"
+#include "MantaKDTreeNode.h"
+
+// Trees built before, kept in a directory (parkd --cache <dir>) and found
+// again by what went into them: the triangles' bounds, -m, the SAH
+// constants and the builder.
+//
+// Each tree is one file, <key>.kdtree in writeToFile()'s layout, mapped
+// read-only on a hit instead of being built again. A new tree is written
+// under a temporary name and renamed into place, so concurrent parkd runs
+// sharing the directory see either all of it or nothing. Once the files
+// add up to more than the size limit, the least recently used ones go;
+// a hit counts as a use. The hit, miss and eviction counts are kept in
+// <dir>/stats across runs.
+class BuildCache {
+public:
+  struct Stats {
+    uint64 hits, misses, evictions;
+    uint entries;
+    uint64 bytes;
+  };
+
+  BuildCache(const std::string &dir, uint64 maxBytes);
+  ~BuildCache(); // unmaps the tree of the last hit
+
+  // The key for building geometry with options by the builder named impl.
+  // The bounds are hashed in fixed chunks in parallel, so the key is the
+  // same for any thread count.
+  static std::string key(const GeometryView &geometry,
+                         const BuildOptions &options, const std::string &impl);
+
+  // maps the tree stored under key; false on a miss
+  bool lookup(const std::string &key);
+
+  // the tree of the last hit
+  const int *items() const { return m_items; }
+  uint numItems() const { return m_numItems; }
+  const MantaKDTreeNode *nodes() const { return m_nodes; }
+  uint numNodes() const { return m_numNodes; }
+
+  // keeps the tree under key, then evicts down to the size limit; false
+  // (after saying why) if it could not be written
+  bool store(const std::string &key, const std::vector<int> &items,
+             const std::vector<MantaKDTreeNode> &nodes);
+
+  // the counts so far and what the directory holds now
+  Stats stats() const;
+
+private:
+  std::string path(const std::string &key) const;
+  void unmap();
+  void evict();
+  // adds to the counts in <dir>/stats, under a lock
+  void count(uint64 hits, uint64 misses, uint64 evictions) const;
+
+  const std::string m_dir;
+  const uint64 m_maxBytes;
+
+  void *m_mapped;
+  size_t m_mappedBytes;
+  const int *m_items;
+  uint m_numItems;
+  const MantaKDTreeNode *m_nodes;
+  uint m_numNodes;
+};
+
+#endif // _BUILDCACHE_H_
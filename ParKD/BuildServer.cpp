@@ -0,0 +1,350 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <vector>
+#include <new>
+#include <exception>
+
+#include "BuildServer.h"
+#include "TriangleMesh.h"
+#include "MantaKDTreeNode.h"
+#include "timers.h"
+
+using namespace std;
+
+namespace {
+
+// read-only istream source over a mapped .blob image
+class MemoryStreamBuf : public streambuf {
+public:
+  MemoryStreamBuf(char *data, size_t size) { setg(data, data, data+size); }
+
+protected:
+  // seekable, so that deserialize() can check counts against the size
+  pos_type seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode) {
+    char *from = (dir == ios_base::beg) ? eback() :
+                 (dir == ios_base::cur) ? gptr() : egptr();
+    if (off < eback() - from || off > egptr() - from) {
+      return pos_type(off_type(-1));
+    }
+    setg(eback(), from + off, egptr());
+    return pos_type(gptr() - eback());
+  }
+  pos_type seekpos(pos_type pos, ios_base::openmode which) {
+    return seekoff(off_type(pos), ios_base::beg, which);
+  }
+};
+
+string errorReply(const string &what) {
+  return "error " + what;
+}
+
+// false (with the reason in error) if the mesh could not be loaded
+bool loadMesh(const string &source, TriangleMesh &mesh, string &error) {
+  if (source.compare(0, 4, "shm:") == 0) {
+    string name = source.substr(4);
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+      error = name + ": " + strerror(errno);
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+      error = name + ": empty";
+      close(fd);
+      return false;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      error = name + ": " + strerror(errno);
+      return false;
+    }
+
+    MemoryStreamBuf buf((char *)data, st.st_size);
+    istream in(&buf);
+    mesh.deserialize(in);
+    munmap(data, st.st_size);
+    if (!in) {
+      error = name + ": truncated or invalid blob";
+      return false;
+    }
+  } else if (!mesh.load(source)) {
+    error = "cannot load " + source;
+    return false;
+  }
+
+  // the builders trust their input; a request must not take the server down
+  for (size_t i=0;i<mesh.indexList.size();i++) {
+    if (mesh.indexList[i] >= mesh.vertexList.size()) {
+      error = source + ": vertex index out of range";
+      return false;
+    }
+  }
+  if (mesh.numTriangles() == 0) {
+    error = source + ": no triangles";
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+BuildServer::BuildServer(const string &socketPath, uint numThreads,
+                         const BuildOptions &defaults, bool quiet)
+  : m_socketPath(socketPath), m_numThreads(numThreads),
+    m_defaults(defaults), m_quiet(quiet), m_listenFd(-1) {
+  m_published = 0;
+}
+
+BuildServer::~BuildServer() {
+  if (m_listenFd >= 0) {
+    close(m_listenFd);
+    unlink(m_socketPath.c_str());
+  }
+}
+
+bool BuildServer::run() {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (m_socketPath.size() >= sizeof(addr.sun_path)) {
+    cerr << "Socket path too long: " << m_socketPath << "\n";
+    return false;
+  }
+  strcpy(addr.sun_path, m_socketPath.c_str());
+
+  m_listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_listenFd < 0) {
+    perror("socket");
+    return false;
+  }
+  unlink(m_socketPath.c_str()); // stale socket of an earlier run
+  if (bind(m_listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(m_listenFd, SOMAXCONN) < 0) {
+    perror(m_socketPath.c_str());
+    close(m_listenFd);
+    m_listenFd = -1;
+    return false;
+  }
+
+  if (!m_quiet) {
+    cerr << "Serving on " << m_socketPath << " with " << m_numThreads
+         << " thread(s)\n";
+  }
+
+  // the calling thread is one of the handlers
+  vector<pthread_t> handlers(m_numThreads-1);
+  for (uint i=0;i<handlers.size();i++) {
+    if (pthread_create(&handlers[i], NULL, handlerMain, this) != 0) {
+      perror("pthread_create");
+      handlers.resize(i);
+      break;
+    }
+  }
+  handlerMain(this);
+  for (uint i=0;i<handlers.size();i++) {
+    pthread_join(handlers[i], NULL);
+  }
+  return true;
+}
+
+void *BuildServer::handlerMain(void *arg) {
+  BuildServer *server = (BuildServer *)arg;
+
+  // one master per handler; its scheduler and allocator caches stay warm
+  // across requests
+  KdTreeBuilder builder(server->m_numThreads);
+
+  for (;;) {
+    int fd = accept(server->m_listenFd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      perror("accept");
+      break;
+    }
+    server->serve(fd, builder);
+    close(fd);
+  }
+  return NULL;
+}
+
+void BuildServer::serve(int fd, KdTreeBuilder &builder) {
+  string pending;
+  char buf[4096];
+
+  for (;;) {
+    size_t eol = pending.find('\n');
+    if (eol == string::npos) {
+      ssize_t cnt = recv(fd, buf, sizeof(buf), 0);
+      if (cnt < 0 && errno == EINTR) continue;
+      if (cnt <= 0) return;
+      pending.append(buf, cnt);
+      continue;
+    }
+
+    string request = pending.substr(0, eol);
+    pending.erase(0, eol+1);
+    if (!request.empty() && request[request.size()-1] == '\r') {
+      request.erase(request.size()-1);
+    }
+    if (request.empty()) continue;
+    if (request == "quit") return;
+
+    string reply = handle(builder, request) + "\n";
+    size_t sent = 0;
+    while (sent < reply.size()) {
+      ssize_t cnt = send(fd, reply.data()+sent, reply.size()-sent,
+                         MSG_NOSIGNAL);
+      if (cnt < 0 && errno == EINTR) continue;
+      if (cnt <= 0) return; // client went away
+      sent += cnt;
+    }
+  }
+}
+
+string BuildServer::handle(KdTreeBuilder &builder, const string &request) {
+  istringstream in(request);
+  string command, source;
+  in >> command >> source;
+  if (command != "build") return errorReply("unknown command: " + command);
+  if (source.empty()) return errorReply("build: no mesh given");
+
+  BuildOptions options = m_defaults;
+  string arg;
+  while (in >> arg) {
+    if (arg == "-m" || arg == "-n") {
+      int value = 0;
+      if (!(in >> value) || value < 1) {
+        return errorReply("bad value for " + arg);
+      }
+      if (arg == "-m") options.maxDepth = value;
+      else options.numThreads = value;
+    } else if (arg == "--superfluous-prescans") {
+      options.superfluousPrescans = true;
+    } else {
+      return errorReply("unknown option: " + arg);
+    }
+  }
+
+  long int start_usec = getTime();
+  string reply;
+  try {
+    TriangleMesh mesh;
+    string error;
+    if (loadMesh(source, mesh, error)) {
+      KdTreeAccel_base *accel = builder.build(mesh, options);
+      reply = publish(*accel);
+      delete accel;
+    } else {
+      reply = errorReply(error);
+    }
+  } catch (std::bad_alloc &) {
+    reply = errorReply(source + ": out of memory");
+  } catch (std::exception &e) {
+    reply = errorReply(source + ": " + e.what());
+  }
+
+  if (!m_quiet) {
+    ostringstream log;
+    log << source << " (" << (getTime() - start_usec) << " us): "
+        << reply << "\n";
+    cerr << log.str();
+  }
+  return reply;
+}
+
+string BuildServer::publish(const KdTreeAccel_base &accel) {
+  vector<int> itemList;
+  vector<MantaKDTreeNode> nodeList;
+  accel.packTree(itemList, nodeList);
+
+  // same layout as writeToFile()
+  const unsigned int itemList_size = itemList.size();
+  const unsigned int nodeList_size = nodeList.size();
+  size_t itemBytes = sizeof(itemList[0])*itemList_size;
+  size_t nodeBytes = sizeof(nodeList[0])*nodeList_size;
+  size_t size = 2*sizeof(unsigned int) + itemBytes + nodeBytes;
+
+  ostringstream name;
+  name << "/parkd-" << getpid() << "-" << m_published++;
+  int fd = shm_open(name.str().c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    return errorReply(name.str() + ": " + strerror(errno));
+  }
+  void *data = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    string reply = errorReply(name.str() + ": " + strerror(errno));
+    shm_unlink(name.str().c_str());
+    return reply;
+  }
+
+  char *out = (char *)data;
+  memcpy(out, &itemList_size, sizeof(itemList_size));
+  out += sizeof(itemList_size);
+  if (itemBytes) memcpy(out, &itemList[0], itemBytes);
+  out += itemBytes;
+  memcpy(out, &nodeList_size, sizeof(nodeList_size));
+  out += sizeof(nodeList_size);
+  memcpy(out, &nodeList[0], nodeBytes);
+  munmap(data, size);
+
+  ostringstream reply;
+  reply << "ok " << name.str() << " " << size << " " << itemList_size
+        << " " << nodeList_size;
+  return reply.str();
+}
@@ -0,0 +1,100 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _BUILDSERVER_H_
+#define _BUILDSERVER_H_
+
+#include <string>
+
+#include <tbb/atomic.h>
+
+#include "BuildOptions.h"
+#include "KdTreeBuilder.h"
+
+// Long-running build service (parkd --serve). Saves every client the
+// process startup and the scheduler/allocator warm-up: a fixed set of
+// handler threads, each a TBB master with its own KdTreeBuilder, accepts
+// connections on a Unix socket and builds requests as they come. The
+// workers are shared by all masters, so concurrent requests are spread over
+// the one pool.
+//
+// The protocol is line-based text, one request per line:
+//
+//   build <mesh> [-m <depth>] [-n <n>] [--superfluous-prescans]
+//   quit
+//
+// <mesh> is a .obj/.blob path, or shm:<name> for a POSIX shared memory
+// object holding a .blob image. -m/-n override the server's defaults (-n as
+// in BuildOptions::numThreads; the pool size is fixed). The reply is
+//
+//   ok <shm name> <bytes> <#items> <#nodes>
+//   error <message>
+//
+// where the shared memory object holds the tree in writeToFile()'s layout.
+// It belongs to the client from then on, which shm_unlink()s it once
+// mapped.
+class BuildServer {
+public:
+  // numThreads is the pool size, and also how many requests are built at
+  // the same time
+  BuildServer(const std::string &socketPath, uint numThreads,
+              const BuildOptions &defaults, bool quiet);
+  ~BuildServer();
+
+  // bind and serve until the process is killed; false if the socket could
+  // not be set up
+  bool run();
+
+  // one request line; the reply, without the newline
+  std::string handle(KdTreeBuilder &builder, const std::string &request);
+
+private:
+  static void *handlerMain(void *server);
+  void serve(int fd, KdTreeBuilder &builder);
+  std::string publish(const KdTreeAccel_base &accel);
+
+  const std::string m_socketPath;
+  const uint m_numThreads;
+  const BuildOptions m_defaults;
+  const bool m_quiet;
+  int m_listenFd;
+  tbb::atomic<uint> m_published; // for unique result names
+};
+
+#endif // _BUILDSERVER_H_
@@ -0,0 +1,67 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#include <cassert>
+
+#include "KdTreeBuilder.h"
+
+// Interface header -- every implementation has this file!
+#include "KdTreeAccel.h"
+
+KdTreeBuilder::KdTreeBuilder(uint numThreads, ThreadPinning pinning)
+  : m_numThreads(numThreads), m_pinner(pinning), m_scheduler(numThreads) {
+  assert(m_numThreads > 0);
+}
+
+KdTreeAccel_base *KdTreeBuilder::build(const TriangleMesh &mesh,
+                                       const BuildOptions &options) {
+  return build(mesh.view(), options);
+}
+
+KdTreeAccel_base *KdTreeBuilder::build(const GeometryView &geometry,
+                                       const BuildOptions &options) {
+  KdTreeAccel *accel = new KdTreeAccel(geometry, options);
+  build(*accel);
+  return accel;
+}
+
+void KdTreeBuilder::build(KdTreeAccel_base &accel) {
+  // accels don't start a scheduler of their own; this one is m_scheduler
+  accel.build();
+}
@@ -0,0 +1,84 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _KDTREEBUILDER_H_
+#define _KDTREEBUILDER_H_
+
+#include <tbb/task_scheduler_init.h>
+
+#include "TriangleMesh.h"
+#include "GeometryView.h"
+#include "BuildOptions.h"
+#include "Numa.h"
+#include "KdTreeAccel_base.h"
+
+// Library entry point. The builder starts the TBB worker pool once and keeps
+// it for every build it runs, so an application can rebuild on each scene
+// change without paying for scheduler startup every time.
+//
+// A TBB scheduler belongs to the thread that created it: construct the
+// builder on the thread that calls build(), one builder per such thread.
+// The pool size is fixed here; BuildOptions::numThreads only sets how many
+// chunks each phase is split into. So is the pinning of the pool threads.
+class KdTreeBuilder {
+public:
+  explicit KdTreeBuilder(uint numThreads, ThreadPinning pinning = PIN_NONE);
+
+  // Build a tree over mesh. The caller owns the result and deletes it to
+  // free the tree; mesh has to outlive it.
+  KdTreeAccel_base *build(const TriangleMesh &mesh,
+                          const BuildOptions &options);
+
+  // Same, straight from the caller's own buffers (see GeometryView); they
+  // have to outlive the result.
+  KdTreeAccel_base *build(const GeometryView &geometry,
+                          const BuildOptions &options);
+
+  // Build an accel set up by the caller (e.g. with a Tracer attached)
+  void build(KdTreeAccel_base &accel);
+
+  uint numThreads() const { return m_numThreads; }
+
+private:
+  uint m_numThreads;
+  ThreadPinner m_pinner; // before m_scheduler: sees every thread join
+  tbb::task_scheduler_init m_scheduler;
+};
+
+#endif // _KDTREEBUILDER_H_
@@ -44,11 +44,26 @@
 #include <iomanip>
 #include <iterator>
 #include <cstdlib>
+#include <signal.h>
+#include <unistd.h>
 
 #include <tbb/task_scheduler_init.h>
 #include <tbb/tick_count.h>
+#include <tbb/spin_mutex.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 
 #include "TriangleMesh.h"
+#include "TreeQuality.h"
+#include "Tracer.h"
+#include "PerfCounters.h"
+#include "BuildOptions.h"
+#include "BuildProgress.h"
+#include "KdTreeBuilder.h"
+#include "BuildServer.h"
+#include "BatchBuilder.h"
+#include "ShardedBuilder.h"
+#include "BuildCache.h"
 
 // Interface header -- every implementation has this file!
 #include "KdTreeAccel.h"
@@ -60,6 +75,79 @@ using namespace std;
 // This needs to be defined by each implementation
 extern void impl_usage();
 
+// --progress: how far the build has got, redrawn in place on stderr at
+// most every 100 ms
+class StderrProgress : public BuildProgress {
+public:
+  StderrProgress()
+    : m_level(0), m_nodes(0), m_edges(0), m_last(tbb::tick_count::now()) { }
+
+  void progress(uint level, uint nodesCompleted, size_t edgesProcessed) {
+    tbb::spin_mutex::scoped_lock lock(m_mutex);
+    // reports from different threads can overtake each other
+    m_level = max(m_level, level);
+    m_nodes = max(m_nodes, nodesCompleted);
+    m_edges = max(m_edges, edgesProcessed);
+    tbb::tick_count now = tbb::tick_count::now();
+    if ((now - m_last).seconds() >= 0.1) {
+      m_last = now;
+      print();
+    }
+  }
+
+  // the final counts, and the line break; nothing if the build never
+  // reported
+  void finish() {
+    if (m_nodes == 0) return;
+    print();
+    cerr << "\n";
+  }
+
+private:
+  void print() {
+    cerr << "\r    level " << m_level << ", " << m_nodes << " nodes, "
+         << m_edges << " edges" << flush;
+  }
+
+  uint m_level, m_nodes;
+  size_t m_edges;
+  tbb::tick_count m_last;
+  tbb::spin_mutex m_mutex;
+};
+
+// --queries: point lookups spread over the tree's bounds, the same points
+// every run; they build the lazy subtrees they reach (see --lazy)
+class LocateQueries {
+public:
+  LocateQueries(KdTreeAccel_base &accel, const BoundingBox &extent)
+    : m_accel(accel), m_extent(extent) { }
+
+  void operator()(const tbb::blocked_range<uint> &range) const {
+    for (uint i=range.begin();i!=range.end();i++) {
+      float p[3];
+      uint h = i * 2654435761u;
+      for (uint k=0;k<3;k++) {
+        h = h * 1664525u + 1013904223u;
+        float t = (h >> 8) / float(1 << 24);
+        p[k] = m_extent.min[k] + t * (m_extent.max[k] - m_extent.min[k]);
+      }
+      m_accel.locate(Vec3f(p[0], p[1], p[2]));
+    }
+  }
+
+private:
+  KdTreeAccel_base &m_accel;
+  const BoundingBox &m_extent;
+};
+
+// Ctrl-C cancels the build, which then returns with what it allocated
+// freed; a second Ctrl-C kills parkd as usual
+static CancelToken interruptToken;
+
+static void onInterrupt(int) {
+  interruptToken.cancel();
+}
+
 void usage() {
   string usage[] = {
     "Usage: ./parkd [Options] [input mesh]",
@@ -82,6 +170,44 @@ void usage() {
     "   --rdtsc         Measure time in ticks using rdtsc instruction",
     "   --superfluous-prescans",
     "                   Performs pre-scan phase even with just a single thread",
+    "   --deterministic Same tree and leaf order for any thread count",
+    "   --snapshots <d,d,..>",
+    "                   Also report (and with --to, write as kdtree-d<d>.binary)",
+    "                   the tree at these depths below -m (in-place only)",
+    "   --lazy <d>      Leave the subtrees below depth <d> for the first query",
+    "                   that reaches them to build (nested only)",
+    "   --queries <n>   Locate <n> points in the tree after the build",
+    "   --move <n>      Then pull the first <n> triangles 10% towards the",
+    "                   middle and update the tree incrementally (nested only)",
+    "   --budget-ms <ms>",
+    "                   Stop splitting <ms> milliseconds into the build and",
+    "                   make leaves of the rest (in-place and nested only)",
+    "   --progress      Show how far the build has got (Ctrl-C cancels it)",
+    "   --trace <file>  Write a per-task timeline of the build to <file>",
+    "                   (Chrome trace format, see chrome://tracing)",
+    "   --perf          Count cycles, instructions, LLC/dTLB/branch misses",
+    "                   per build phase (perf_event_open)",
+    "   --out-of-core <dir>",
+    "                   Keep the big edge arrays in files in <dir>, for meshes",
+    "                   that do not fit in RAM (in-place only)",
+    "   --compact <k>   Every <k> levels, drop the triangles that are only in",
+    "                   leaves from the edge sweeps (in-place only)",
+    "   --segmented     Regroup the edges by tree node between levels, so",
+    "                   each node's sweep is contiguous (in-place SoA only)",
+    "   --numa <p>      Place the big build arrays: first-touch (by the",
+    "                   threads that work on them) or interleave",
+    "   --pin <p>       Pin worker threads to cores or sockets",
+    "   --batch         Build a separate tree for each input mesh, several at",
+    "                   a time, writing each to <mesh>.kdtree",
+    "   --shards <k>    Build the top k levels here and the subtrees below in",
+    "                   one worker process per NUMA node",
+    "   --serve <sock>  Keep running and build requests from a Unix socket",
+    "                   (protocol in ParKD/BuildServer.h)",
+    "   --cache <dir>   Reuse the tree of an earlier run with the same mesh",
+    "                   and parameters, kept in <dir>, instead of building",
+    "   --cache-size <MB>",
+    "                   Evict the least recently used trees in the cache",
+    "                   beyond this size (default 1024)",
     "",
 //     "EXAMPLES:",
 //     "  ./fast -n 16 --tbb teapot.obj",
@@ -113,11 +239,6 @@ void usage() {
   exit(0);
 }
 
-// Global variables 
-bool g_time_in_ticks;
-bool g_superfluous_prescans;
-bool g_verbose;
-
 int main(int argc, char *argv[]) {
     // Load input mesh
     TriangleMesh * myMesh = new TriangleMesh();
@@ -128,12 +249,17 @@ int main(int argc, char *argv[]) {
     bool output = false, csv = false,
       csv_header = false, graphviz = false, 
       graphvizAccm = false, treeout = false,
-      quiet = false;
+      quiet = false, perf = false, batch = false, progress = false;
     vector<std::string> input;
-
-    g_time_in_ticks = false;
-    g_superfluous_prescans = false;
-    g_verbose = false;
+    char *trace_file = NULL;
+    char *serve_path = NULL;
+    unsigned int shardLevels = 0;
+    unsigned int queries = 0;
+    unsigned int moveCount = 0;
+    string cacheDir;
+    unsigned int cacheMB = 1024;
+    ThreadPinning pinning = PIN_NONE;
+    BuildOptions options;
 
     for (unsigned int i=1;i<argc;i++) {
       if (!strcmp(argv[i], "-h")) {
@@ -152,7 +278,7 @@ int main(int argc, char *argv[]) {
       } else if (!strcmp(argv[i], "--to")) {
         treeout = true;
       } else if (!strcmp(argv[i], "-v")) {
-        g_verbose = true;
+        options.verbose = true;
       } else if (!strcmp(argv[i], "-q")) {
         quiet = true;
       } else if (!strcmp(argv[i], "--csv")) {
@@ -174,11 +300,159 @@ int main(int argc, char *argv[]) {
       } else if (!strcmp(argv[i], "--graphvizAccm")) {
         graphvizAccm = true;
       } else if (!strcmp(argv[i], "--seconds")) {
-        g_time_in_ticks = false;
+        options.timeInTicks = false;
       } else if (!strcmp(argv[i], "--rdtsc")) {
-        g_time_in_ticks = true;
+        options.timeInTicks = true;
       } else if (!strcmp(argv[i], "--superfluous-prescans")) {
-        g_superfluous_prescans = true;
+        options.superfluousPrescans = true;
+      } else if (!strcmp(argv[i], "--deterministic")) {
+        options.deterministic = true;
+      } else if (!strcmp(argv[i], "--snapshots")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else {
+          char *depth = argv[i];
+          while (*depth) {
+            char *end;
+            long d = strtol(depth, &end, 10);
+            if (end == depth || d < 1 || (*end && *end != ',')) {
+              usage();
+            }
+            options.snapshotDepths.push_back(d);
+            depth = *end ? end+1 : end;
+          }
+        }
+      } else if (!strcmp(argv[i], "--lazy")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else {
+          int depth = atoi(argv[i]);
+          if (depth < 1) {
+            usage();
+          }
+          options.lazyDepth = depth;
+        }
+      } else if (!strcmp(argv[i], "--queries")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else {
+          int n = atoi(argv[i]);
+          if (n < 1) {
+            usage();
+          }
+          queries = n;
+        }
+      } else if (!strcmp(argv[i], "--move")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else {
+          int n = atoi(argv[i]);
+          if (n < 1) {
+            usage();
+          }
+          moveCount = n;
+          options.incremental = true;
+        }
+      } else if (!strcmp(argv[i], "--budget-ms")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else {
+          int budget = atoi(argv[i]);
+          if (budget < 1) {
+            usage();
+          }
+          options.budgetMs = budget;
+        }
+      } else if (!strcmp(argv[i], "--progress")) {
+        progress = true;
+      } else if (!strcmp(argv[i], "--perf")) {
+        perf = true;
+      } else if (!strcmp(argv[i], "--trace")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else {
+          trace_file = argv[i];
+        }
+      } else if (!strcmp(argv[i], "--out-of-core")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else {
+          if (access(argv[i], W_OK) != 0) {
+            cerr << "Cannot write to " << argv[i] << "\n";
+            exit(-1);
+          }
+          options.outOfCoreDir = argv[i];
+        }
+      } else if (!strcmp(argv[i], "--compact")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else {
+          int every = atoi(argv[i]);
+          if (every < 1) {
+            usage();
+          }
+          options.compactEvery = every;
+        }
+      } else if (!strcmp(argv[i], "--segmented")) {
+        options.segmented = true;
+      } else if (!strcmp(argv[i], "--cache")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else {
+          if (access(argv[i], W_OK) != 0) {
+            cerr << "Cannot write to " << argv[i] << "\n";
+            exit(-1);
+          }
+          cacheDir = argv[i];
+        }
+      } else if (!strcmp(argv[i], "--cache-size")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else {
+          int mb = atoi(argv[i]);
+          if (mb < 1) {
+            usage();
+          }
+          cacheMB = mb;
+        }
+      } else if (!strcmp(argv[i], "--numa")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else if (!strcmp(argv[i], "first-touch")) {
+          options.numaPolicy = NUMA_FIRST_TOUCH;
+        } else if (!strcmp(argv[i], "interleave")) {
+          options.numaPolicy = NUMA_INTERLEAVE;
+        } else {
+          usage();
+        }
+      } else if (!strcmp(argv[i], "--pin")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else if (!strcmp(argv[i], "cores")) {
+          pinning = PIN_CORES;
+        } else if (!strcmp(argv[i], "sockets")) {
+          pinning = PIN_SOCKETS;
+        } else {
+          usage();
+        }
+      } else if (!strcmp(argv[i], "--batch")) {
+        batch = true;
+      } else if (!strcmp(argv[i], "--shards")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else {
+          int levels = atoi(argv[i]);
+          if (levels < 1) {
+            usage();
+          }
+          shardLevels = levels;
+        }
+      } else if (!strcmp(argv[i], "--serve")) {
+        i++;
+        if (argc <= i) { usage(); }
+        else {
+          serve_path = argv[i];
+        }
       } else {
         if (argv[i][0] == '-') {
           cerr << "Unknown option : " << argv[i] << endl;
@@ -190,7 +464,7 @@ int main(int argc, char *argv[]) {
     }
 
     // Sanity check
-    if (!csv_header && input.size() < 1) {
+    if (!csv_header && !serve_path && input.size() < 1) {
       if (quiet) {
         exit(-1);
       } else {
@@ -198,18 +472,87 @@ int main(int argc, char *argv[]) {
       }
     }
 
-    if (g_superfluous_prescans && nthreads > 1) {
+    if (options.superfluousPrescans && nthreads > 1) {
       cerr << "--superfluous-prescans option is meaningless in non-sequential runs\n\n";
     }
 
-    KdTreeAccel *myAccel = new KdTreeAccel(myMesh, nthreads, maxdepth);
+    options.numThreads = nthreads;
+    options.maxDepth = maxdepth;
+
+    if (shardLevels >= maxdepth) {
+      cerr << "--shards has to be below the maximum height (-m)\n";
+      exit(-1);
+    }
+
+    if (options.lazyDepth >= maxdepth) {
+      cerr << "--lazy has to be below the maximum height (-m)\n";
+      exit(-1);
+    }
+
+    if (serve_path) {
+      BuildServer server(serve_path, nthreads, options, quiet);
+      return server.run() ? 0 : -1;
+    }
+
+    if (options.numaPolicy != NUMA_DEFAULT && numaNodeCount() < 2 && !quiet) {
+      cerr << "Only one NUMA node available; --numa has no effect\n\n";
+    }
+
+    if (batch) {
+      KdTreeBuilder builder(nthreads, pinning);
+      BatchBuilder batchBuilder(options, quiet);
+      for (unsigned int i=0;i<input.size();i++) {
+        batchBuilder.add(input[i]);
+      }
+      return batchBuilder.run(builder) ? 0 : -1;
+    }
+
+    KdTreeAccel *myAccel = new KdTreeAccel(GeometryView(), options);
+
+    Tracer *tracer = NULL;
+    if (trace_file) {
+      tracer = new Tracer();
+      myAccel->setTracer(tracer);
+    }
+
+    // counters have to be set up before the builder starts its scheduler
+    PerfCounters *perfCounters = NULL;
+    if (perf) {
+      perfCounters = new PerfCounters();
+      if (!perfCounters->available()) {
+        cerr << "Hardware counters unavailable (" << perfCounters->error() 
+             << "), continuing without them\n";
+      }
+      myAccel->setPerfCounters(perfCounters);
+    }
+
+    StderrProgress *progressReport = NULL;
+    if (progress) {
+      progressReport = new StderrProgress();
+      myAccel->setProgress(progressReport);
+    }
+
+    myAccel->setCancelToken(&interruptToken);
+    struct sigaction interrupt;
+    memset(&interrupt, 0, sizeof(interrupt));
+    interrupt.sa_handler = onInterrupt;
+    interrupt.sa_flags = SA_RESETHAND;
+    sigaction(SIGINT, &interrupt, NULL);
 
     if (csv_header) {
       cerr << "Threads,Start time,Mesh load finish time,Build start time,Build finish time";
       myAccel->printTimingStatsCSVHeader(cerr);
+      TreeQuality::printCSVHeader(cerr, maxdepth);
+      if (perf) {
+        PerfCounters::printCSVHeader(cerr);
+      }
+      cerr << "\n";
       exit(0);
     }
 
+    // worker pool for the build and the analysis below
+    KdTreeBuilder builder(nthreads, pinning);
+
     // Print headers here
     if (!quiet && !csv) {
       cerr << "ParKD - " << myAccel->impl_string() << "\n\n";
@@ -219,12 +562,59 @@ int main(int argc, char *argv[]) {
       cerr << "\n"
            << indent << setw(24) << " Threads" << " : " << nthreads << "\n"
            << indent << setw(24) << " MaxDepth" << " : " << maxdepth << "\n"
-           << indent << setw(24) << " Superfluous Prescans" << " : " << (g_superfluous_prescans?"Yes":"no")
-           << "\n\n";
+           << indent << setw(24) << " Superfluous Prescans" << " : " << (options.superfluousPrescans?"Yes":"no")
+           << "\n";
+      if (options.deterministic) {
+        cerr << indent << setw(24) << " Deterministic" << " : " << "Yes" << "\n";
+      }
+      if (!options.snapshotDepths.empty()) {
+        cerr << indent << setw(24) << " Snapshots" << " : ";
+        copy(options.snapshotDepths.begin(), options.snapshotDepths.end(),
+             ostream_iterator<uint>(cerr, " "));
+        cerr << "\n";
+      }
+      if (shardLevels) {
+        cerr << indent << setw(24) << " Shards" << " : "
+             << "below level " << shardLevels << "\n";
+      }
+      if (options.lazyDepth) {
+        cerr << indent << setw(24) << " Lazy" << " : "
+             << "below level " << options.lazyDepth << "\n";
+      }
+      if (!cacheDir.empty()) {
+        cerr << indent << setw(24) << " Cache" << " : "
+             << cacheDir << " (" << cacheMB << " MB)\n";
+      }
+      if (options.budgetMs) {
+        cerr << indent << setw(24) << " Budget" << " : "
+             << options.budgetMs << " ms\n";
+      }
+      if (options.compactEvery) {
+        cerr << indent << setw(24) << " Compaction" << " : "
+             << "every " << options.compactEvery << " levels\n";
+      }
+      if (options.segmented) {
+        cerr << indent << setw(24) << " Edge layout" << " : "
+             << "segmented by node\n";
+      }
+      if (!options.outOfCoreDir.empty()) {
+        cerr << indent << setw(24) << " Out of core" << " : "
+             << options.outOfCoreDir << "\n";
+      }
+      if (options.numaPolicy != NUMA_DEFAULT) {
+        cerr << indent << setw(24) << " NUMA placement" << " : "
+             << (options.numaPolicy == NUMA_FIRST_TOUCH ?
+                 "first-touch" : "interleave") << "\n";
+      }
+      if (pinning != PIN_NONE) {
+        cerr << indent << setw(24) << " Pinning" << " : "
+             << (pinning == PIN_CORES ? "cores" : "sockets") << "\n";
+      }
+      cerr << "\n";
     }
 
     // Process the input mesh
-    if (g_verbose) {
+    if (options.verbose) {
       cerr << "==> Processing input mesh\n";
     }
 
@@ -233,7 +623,7 @@ int main(int argc, char *argv[]) {
     RECORD_TIME(start_usec, start_tick);
 
     for (unsigned int i=0;i<input.size();i++) {
-      if (g_verbose) {
+      if (options.verbose) {
         cerr << "    " << input[i] << "\n";
       }
       string &file = input[i];
@@ -249,27 +639,153 @@ int main(int argc, char *argv[]) {
       }
     }
 
-    if (g_verbose) {
+    if (options.verbose) {
       cerr << "\n";
     }
 
+    // the accel was needed above, before there was anything to build over
+    myAccel->setGeometry(myMesh->view());
+
+    if (shardLevels) {
+      ShardedBuilder sharded(options, shardLevels, quiet);
+      bool ok = sharded.build(builder, *myMesh);
+      if (ok && !quiet) {
+        cerr << "              TIMING INFORMATION (in microseconds)\n\n"
+             << setw(34) << left << "Shards" << ": "
+             << setw(20) << right << sharded.numShards() << "\n"
+             << setw(34) << left << "Top levels time" << ": "
+             << setw(20) << right << sharded.topUsec << "\n"
+             << setw(34) << left << "Shard builds time" << ": "
+             << setw(20) << right << sharded.shardsUsec << "\n"
+             << setw(34) << left << "Stitch time" << ": "
+             << setw(20) << right << sharded.stitchUsec << "\n\n";
+        TreeQuality quality;
+        quality.compute(sharded.nodes(), sharded.extent(), myAccel->sah,
+                        myMesh->numTriangles());
+        quality.print(cerr);
+      }
+      if (ok && treeout) {
+        cerr << "Writing out the tree (for Manta)" << endl;
+        ok = KdTreeAccel_base::writeToFile("kdtree.binary", sharded.items(),
+                                           sharded.nodes());
+      }
+      delete myAccel;
+      return ok ? 0 : -1;
+    }
+
     uint64 mesh_finish_tick;
     long int mesh_finish_usec;
     RECORD_TIME(mesh_finish_usec, mesh_finish_tick);
 
+    // a cached tree is only the plain build's: no other trees, no partial
+    // ones, and nothing that needs the builder's own nodes afterwards
+    BuildCache *cache = NULL;
+    string cacheKey;
+    bool cacheHit = false;
+    if (!cacheDir.empty()) {
+      if (options.budgetMs || options.lazyDepth || moveCount || queries ||
+          !options.snapshotDepths.empty() || output || graphviz ||
+          graphvizAccm) {
+        if (!quiet) {
+          cerr << "Cache not used (with --budget-ms, --lazy, --queries, "
+               << "--move, --snapshots, -o or --graphviz)\n\n";
+        }
+      } else {
+        cache = new BuildCache(cacheDir, (uint64)cacheMB << 20);
+        cacheKey = BuildCache::key(myMesh->view(), options,
+                                   myAccel->impl_string());
+        cacheHit = cache->lookup(cacheKey);
+      }
+    }
+
     uint64 build_start_tick;
     long int build_start_usec;
     RECORD_TIME(build_start_usec, build_start_tick);
 
     // Entry point
-    myAccel->build();
+    if (!cacheHit) {
+      PerfScope buildPerf(perfCounters, PERF_BUILD);
+      builder.build(*myAccel);
+    }
 
     uint64 build_finish_tick;
     long int build_finish_usec;
     RECORD_TIME(build_finish_usec, build_finish_tick);
 
+    if (progressReport) {
+      progressReport->finish();
+      delete progressReport;
+    }
+
+    if (myAccel->cancelled()) {
+      cerr << "Build cancelled\n";
+      delete cache;
+      delete tracer;
+      delete perfCounters;
+      delete myAccel;
+      return -1;
+    }
+
+    if (cache && !cacheHit) {
+      vector<int> items;
+      vector<MantaKDTreeNode> nodes;
+      myAccel->packTree(items, nodes);
+      cache->store(cacheKey, items, nodes);
+    }
+
+    uint64 store_finish_tick;
+    long int store_finish_usec;
+    RECORD_TIME(store_finish_usec, store_finish_tick);
+
+    if (queries) {
+      LocateQueries locate(*myAccel, myAccel->root()->extent);
+      tbb::parallel_for(tbb::blocked_range<uint>(0, queries), locate);
+    }
+
+    uint64 query_finish_tick;
+    long int query_finish_usec;
+    RECORD_TIME(query_finish_usec, query_finish_tick);
+
+    // an edit to the scene: the triangles move, the tree catches up
+    bool rebuilt = false;
+    if (moveCount) {
+      TriangleBounds &bounds = myMesh->bounds;
+      const BoundingBox &box = myMesh->boundingBox;
+      vector<int> changed;
+      vector<BoundingBox> changedBounds;
+      for (unsigned int i=0;i<moveCount && i<myMesh->numTriangles();i++) {
+        BoundingBox b;
+        for (unsigned int k=0;k<3;k++) {
+          float middle = 0.5f * (box.min[k] + box.max[k]);
+          bounds.min[k][i] = middle + 0.9f * (bounds.min[k][i] - middle);
+          bounds.max[k][i] = middle + 0.9f * (bounds.max[k][i] - middle);
+          b.min[k] = bounds.min[k][i];
+          b.max[k] = bounds.max[k][i];
+        }
+        changed.push_back(i);
+        changedBounds.push_back(b);
+      }
+      rebuilt = myAccel->rebuild(changed, changedBounds, 0.1f);
+      if (!rebuilt && !quiet) {
+        cerr << "No incremental rebuild (nested builder only)\n";
+      }
+    }
+
+    uint64 rebuild_finish_tick;
+    long int rebuild_finish_usec;
+    RECORD_TIME(rebuild_finish_usec, rebuild_finish_tick);
+
+    // Analyze the tree (not part of the build time)
+    TreeQuality quality;
+    if (cacheHit && (!quiet || csv)) {
+      quality.compute(cache->nodes(), myMesh->boundingBox, myAccel->sah,
+                      myMesh->numTriangles());
+    } else if (!quiet || csv) {
+      myAccel->computeTreeQuality(quality);
+    }
+
     if (!quiet && !csv) {
-      if (g_time_in_ticks) {
+      if (options.timeInTicks) {
         cerr << "              TIMING INFORMATION (in CPU ticks)\n\n";
         
         cerr << setw(34) << left << "Start time" << ": " << setw(20) << right << start_tick << "\n"
@@ -295,13 +811,61 @@ int main(int argc, char *argv[]) {
              << setw(34) << left << "Mesh load time" << ": "
              << setw(20) << right << (mesh_finish_usec - start_usec) << "\n";
         
-        cerr << setw(34) << left << "Build time" << ": " 
-             << setw(20) << right << (build_finish_usec - build_start_usec) << "\n\n";
+        if (cache) {
+          cerr << setw(34) << left << "Cache lookup time" << ": "
+               << setw(20) << right << (build_start_usec - mesh_finish_usec) << "\n";
+        }
+        if (!cacheHit) {
+          cerr << setw(34) << left << "Build time" << ": " 
+               << setw(20) << right << (build_finish_usec - build_start_usec) << "\n";
+        }
+        if (cache && !cacheHit) {
+          cerr << setw(34) << left << "Cache store time" << ": "
+               << setw(20) << right << (store_finish_usec - build_finish_usec) << "\n";
+        }
+        if (queries) {
+          cerr << setw(34) << left << "Query time" << ": "
+               << setw(20) << right << (query_finish_usec - build_finish_usec) << "\n"
+               << setw(34) << left << "Subtrees built on demand" << ": "
+               << setw(20) << right << myAccel->lazyBuilt() << "\n";
+        }
+        if (rebuilt) {
+          cerr << setw(34) << left << "Rebuild time" << ": "
+               << setw(20) << right << (rebuild_finish_usec - query_finish_usec) << "\n"
+               << setw(34) << left << "Subtrees rebuilt" << ": "
+               << setw(20) << right << myAccel->subtreesRebuilt() << "\n";
+        }
+        cerr << "\n";
         
-        myAccel->printTimingStats(cerr);
+        if (!cacheHit) {
+          myAccel->printTimingStats(cerr);
+        }
       } 
+
+      if (cache) {
+        BuildCache::Stats stats = cache->stats();
+        cerr << "\n"
+             << setw(34) << left << "Build cache" << ": "
+             << setw(20) << right << (cacheHit ? "hit" : "miss") << "\n"
+             << setw(34) << left << "Cache hits / misses" << ": "
+             << setw(20) << right << stats.hits << " / " << stats.misses << "\n"
+             << setw(34) << left << "Cache evictions" << ": "
+             << setw(20) << right << stats.evictions << "\n"
+             << setw(34) << left << "Cached trees (bytes)" << ": "
+             << setw(20) << right << stats.entries
+             << " (" << stats.bytes << ")\n";
+      }
+
+      cerr << "\n";
+      quality.print(cerr);
+
+      if (perfCounters) {
+        cerr << "\n";
+        perfCounters->print(cerr);
+      }
     } else if (csv) {
-      if (g_time_in_ticks) {
+      // on a cache hit the builder never ran, and its columns are all 0
+      if (options.timeInTicks) {
         cerr << nthreads << ","
              << start_tick << ","
              << mesh_finish_tick << ","
@@ -317,8 +881,30 @@ int main(int argc, char *argv[]) {
              << build_finish_usec;
         myAccel->printTimingStatsCSV(cerr);
       }
+      quality.printCSV(cerr, maxdepth);
+      if (perfCounters) {
+        perfCounters->printCSV(cerr);
+      }
+      cerr << "\n";
     }
     
+    // the shallower trees captured on the way
+    const vector<TreeSnapshot> &snapshots = myAccel->snapshots();
+    if (!options.snapshotDepths.empty() && snapshots.empty() && !quiet) {
+      cerr << "No snapshots taken (in-place builders, depths below -m only)\n";
+    }
+    for (unsigned int i=0;i<snapshots.size();i++) {
+      if (!quiet && !csv) {
+        cerr << "\n              SNAPSHOT AT DEPTH " << snapshots[i].depth << "\n\n";
+        snapshots[i].quality.print(cerr);
+      }
+      if (treeout) {
+        char name[64];
+        sprintf(name, "kdtree-d%u.binary", snapshots[i].depth);
+        KdTreeAccel_base::writeToFile(name, snapshots[i].items, snapshots[i].nodes);
+      }
+    }
+
     if (output) {
       myAccel->printTree();
     }
@@ -326,7 +912,13 @@ int main(int argc, char *argv[]) {
     // write tree to file
     if (treeout) {
       cerr << "Writing out the tree (for Manta)" << endl;
-      myAccel->writeToFile("kdtree.binary");
+      if (cacheHit) {
+        KdTreeAccel_base::writeToFile("kdtree.binary", cache->items(),
+                                      cache->numItems(), cache->nodes(),
+                                      cache->numNodes());
+      } else {
+        myAccel->writeToFile("kdtree.binary");
+      }
     }
     
     if (graphviz) {
@@ -335,6 +927,18 @@ int main(int argc, char *argv[]) {
       myAccel->printGraphvizAccm();
     }
     
+    if (tracer) {
+      if (!tracer->write(trace_file)) {
+        cerr << "Could not write trace file: " << trace_file << "\n";
+      }
+      delete tracer;
+    }
+
+    if (perfCounters) {
+      delete perfCounters;
+    }
+
+    delete cache;
     delete myAccel;
 
 	return 0;
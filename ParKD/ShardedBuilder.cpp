@@ -0,0 +1,426 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include "ShardedBuilder.h"
+#include "Numa.h"
+#include "timers.h"
+
+using namespace std;
+
+namespace {
+
+struct DispatchArg {
+  ShardedBuilder *builder;
+  uint worker;
+};
+
+void *dispatchMain(void *arg) {
+  DispatchArg *dispatch = (DispatchArg *)arg;
+  dispatch->builder->dispatch(dispatch->worker);
+  return NULL;
+}
+
+// the worker comes up in the background; give it a few seconds to bind
+int connectTo(const string &path, pid_t worker) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+
+  for (uint attempt=0;attempt<500;attempt++) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) return fd;
+    close(fd);
+    if (kill(worker, 0) != 0) return -1;
+    usleep(10000);
+  }
+  return -1;
+}
+
+bool sendAll(int fd, const string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t cnt = send(fd, data.data()+sent, data.size()-sent, MSG_NOSIGNAL);
+    if (cnt < 0 && errno == EINTR) continue;
+    if (cnt <= 0) return false;
+    sent += cnt;
+  }
+  return true;
+}
+
+// one request is outstanding at a time, so nothing follows the newline
+bool readLine(int fd, string &line) {
+  line.clear();
+  char buf[256];
+  for (;;) {
+    ssize_t cnt = recv(fd, buf, sizeof(buf), 0);
+    if (cnt < 0 && errno == EINTR) continue;
+    if (cnt <= 0) return false;
+    line.append(buf, cnt);
+    size_t eol = line.find('\n');
+    if (eol != string::npos) {
+      line.erase(eol);
+      return true;
+    }
+  }
+}
+
+bool writeShm(const string &name, const string &data, string &error) {
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    error = name + ": " + strerror(errno);
+    return false;
+  }
+  void *mapped = MAP_FAILED;
+  if (ftruncate(fd, data.size()) == 0) {
+    mapped = mmap(NULL, data.size(), PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd, 0);
+  }
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    error = name + ": " + strerror(errno);
+    shm_unlink(name.c_str());
+    return false;
+  }
+  memcpy(mapped, data.data(), data.size());
+  munmap(mapped, data.size());
+  return true;
+}
+
+// a tree published by BuildServer; the object is gone afterwards
+bool readTreeShm(const string &name, size_t bytes, vector<int> &items,
+                 vector<MantaKDTreeNode> &nodes, string &error) {
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    error = name + ": " + strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (bytes < 2*sizeof(uint) || fstat(fd, &st) != 0 ||
+      (uint64)st.st_size < bytes) {
+    close(fd);
+    shm_unlink(name.c_str());
+    error = name + ": malformed tree";
+    return false;
+  }
+  void *mapped = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  shm_unlink(name.c_str());
+  if (mapped == MAP_FAILED) {
+    error = name + ": " + strerror(errno);
+    return false;
+  }
+
+  // same layout as writeToFile(); the counts must add up to bytes before
+  // anything is copied
+  const char *in = (const char *)mapped;
+  uint numItems, numNodes;
+  memcpy(&numItems, in, sizeof(numItems));
+  uint64 nodesAt = sizeof(uint) + (uint64)numItems*sizeof(int);
+  bool ok = nodesAt + sizeof(uint) <= bytes;
+  if (ok) {
+    memcpy(&numNodes, in + nodesAt, sizeof(numNodes));
+    ok = nodesAt + sizeof(uint) +
+      (uint64)numNodes*sizeof(MantaKDTreeNode) == bytes && numNodes > 0;
+  }
+  if (!ok) {
+    munmap(mapped, bytes);
+    error = name + ": malformed tree";
+    return false;
+  }
+
+  items.resize(numItems);
+  if (numItems) memcpy(&items[0], in + sizeof(uint), numItems*sizeof(int));
+  nodes.resize(numNodes);
+  if (numNodes) {
+    memcpy(&nodes[0], in + nodesAt + sizeof(uint),
+           numNodes*sizeof(MantaKDTreeNode));
+  }
+  munmap(mapped, bytes);
+  return true;
+}
+
+} // namespace
+
+ShardedBuilder::ShardedBuilder(const BuildOptions &options, uint shardLevels,
+                               bool quiet)
+  : topUsec(0), shardsUsec(0), stitchUsec(0), m_options(options),
+    m_shardLevels(shardLevels), m_quiet(quiet), m_mesh(NULL) {
+  m_next = 0;
+}
+
+ShardedBuilder::~ShardedBuilder() {
+  stopWorkers();
+}
+
+bool ShardedBuilder::build(KdTreeBuilder &builder, const TriangleMesh &mesh) {
+  m_mesh = &mesh;
+  m_shards.clear();
+
+  // the top levels, in this process
+  long int start_usec = getTime();
+  BuildOptions top = m_options;
+  top.maxDepth = m_shardLevels;
+  KdTreeAccel_base *accel = builder.build(mesh, top);
+  accel->packTree(m_items, m_nodes);
+  m_extent = accel->root()->extent;
+  delete accel;
+
+  // leaves cut off by the depth limit are the shards; the others are final
+  vector<pair<uint, uint> > stack(1, make_pair(0u, 0u)); // node, depth
+  while (!stack.empty() && m_shardLevels < m_options.maxDepth) {
+    uint idx = stack.back().first, depth = stack.back().second;
+    stack.pop_back();
+    const MantaKDTreeNode &node = m_nodes[idx];
+    if (!node.isLeaf) {
+      stack.push_back(make_pair((uint)node.childIdx, depth+1));
+      stack.push_back(make_pair((uint)node.childIdx+1, depth+1));
+    } else if (depth == m_shardLevels && node.numPrimitives > 0) {
+      m_shards.push_back(Shard());
+      Shard &shard = m_shards.back();
+      shard.nodeIdx = idx;
+      shard.triangles.assign(m_items.begin() + node.childIdx,
+                             m_items.begin() + node.childIdx + node.numPrimitives);
+      shard.error = "not built";
+    }
+  }
+  topUsec = getTime() - start_usec;
+
+  // largest first, so the longest builds don't start last
+  start_usec = getTime();
+  stable_sort(m_shards.begin(), m_shards.end());
+  if (!m_shards.empty()) {
+    vector<cpu_set_t> nodeCpus = numaNodeCpus();
+    uint count = min(nodeCpus.size(), m_shards.size());
+    if (!startWorkers(nodeCpus, count)) {
+      return false;
+    }
+
+    m_next = 0;
+    vector<DispatchArg> args(count);
+    vector<pthread_t> threads(count);
+    for (uint w=0;w<count;w++) {
+      args[w].builder = this;
+      args[w].worker = w;
+      if (pthread_create(&threads[w], NULL, dispatchMain, &args[w]) != 0) {
+        perror("pthread_create");
+        threads.resize(w);
+        break;
+      }
+    }
+    for (uint w=0;w<threads.size();w++) {
+      pthread_join(threads[w], NULL);
+    }
+    stopWorkers();
+  }
+  shardsUsec = getTime() - start_usec;
+
+  bool ok = true;
+  for (uint i=0;i<m_shards.size();i++) {
+    if (!m_shards[i].error.empty()) {
+      cerr << "Shard of " << m_shards[i].triangles.size() << " triangles: "
+           << m_shards[i].error << "\n";
+      ok = false;
+    }
+  }
+  if (!ok) return false;
+
+  start_usec = getTime();
+  stitch();
+  stitchUsec = getTime() - start_usec;
+  return true;
+}
+
+bool ShardedBuilder::startWorkers(const vector<cpu_set_t> &nodeCpus,
+                                  uint count) {
+  for (uint w=0;w<count;w++) {
+    ostringstream socketPath, threads;
+    socketPath << "/tmp/parkd-shards-" << getpid() << "-" << w << ".sock";
+    threads << CPU_COUNT(&nodeCpus[w]);
+
+    // everything the child needs, before the fork
+    string path = socketPath.str(), n = threads.str();
+    const char *argv[] = { "parkd", "--serve", path.c_str(), "-n", n.c_str(),
+                           "-q", NULL };
+    pid_t pid = fork();
+    if (pid == 0) {
+      sched_setaffinity(0, sizeof(cpu_set_t), &nodeCpus[w]);
+      execv("/proc/self/exe", (char *const *)argv);
+      _exit(127);
+    }
+    if (pid < 0) {
+      perror("fork");
+      return false;
+    }
+    m_workers.push_back(pid);
+    m_sockets.push_back(path);
+    m_workerThreads.push_back(CPU_COUNT(&nodeCpus[w]));
+  }
+  return true;
+}
+
+void ShardedBuilder::stopWorkers() {
+  for (uint w=0;w<m_workers.size();w++) {
+    kill(m_workers[w], SIGTERM);
+    waitpid(m_workers[w], NULL, 0);
+    unlink(m_sockets[w].c_str());
+  }
+  m_workers.clear();
+  m_sockets.clear();
+  m_workerThreads.clear();
+}
+
+void ShardedBuilder::dispatch(uint worker) {
+  int fd = connectTo(m_sockets[worker], m_workers[worker]);
+  if (fd < 0) {
+    cerr << "Cannot reach worker at " << m_sockets[worker] << "\n";
+    return; // the others take its shards
+  }
+  for (;;) {
+    uint i = m_next++;
+    if (i >= m_shards.size()) break;
+    if (!buildShard(fd, worker, m_shards[i])) break;
+  }
+  close(fd);
+}
+
+bool ShardedBuilder::buildShard(int fd, uint worker, Shard &shard) {
+  // a mesh of its own, three vertices per triangle
+  TriangleMesh mesh;
+  mesh.vertexList.reserve(3*shard.triangles.size());
+  mesh.indexList.reserve(3*shard.triangles.size());
+  for (uint i=0;i<shard.triangles.size();i++) {
+    for (uint v=0;v<3;v++) {
+      mesh.indexList.push_back(mesh.vertexList.size());
+      mesh.vertexList.push_back(
+        m_mesh->vertexList[m_mesh->indexList[3*shard.triangles[i]+v]]);
+    }
+  }
+  ostringstream blob;
+  mesh.serialize(blob);
+
+  ostringstream name;
+  name << "/parkd-shard-" << getpid() << "-" << shard.nodeIdx;
+  if (!writeShm(name.str(), blob.str(), shard.error)) return true;
+
+  ostringstream request;
+  request << "build shm:" << name.str()
+          << " -m " << (m_options.maxDepth - m_shardLevels)
+          << " -n " << m_workerThreads[worker]
+          << "\n";
+  string reply;
+  bool connected = sendAll(fd, request.str()) && readLine(fd, reply);
+  shm_unlink(name.str().c_str());
+  if (!connected) {
+    shard.error = "worker went away";
+    return false;
+  }
+
+  istringstream in(reply);
+  string status, result;
+  size_t bytes = 0;
+  in >> status >> result >> bytes;
+  if (status != "ok") {
+    shard.error = reply;
+    return true;
+  }
+  if (readTreeShm(result, bytes, shard.items, shard.nodes, shard.error)) {
+    shard.error.clear();
+  }
+  return true;
+}
+
+void ShardedBuilder::stitch() {
+  // the top levels' final leaves keep their items, packed to the front
+  vector<int> items;
+  items.reserve(m_items.size());
+  vector<bool> isShard(m_nodes.size(), false);
+  for (uint i=0;i<m_shards.size();i++) {
+    isShard[m_shards[i].nodeIdx] = true;
+  }
+  for (uint i=0;i<m_nodes.size();i++) {
+    MantaKDTreeNode &node = m_nodes[i];
+    if (!node.isLeaf || isShard[i]) continue;
+    uint offset = items.size();
+    items.insert(items.end(), m_items.begin() + node.childIdx,
+                 m_items.begin() + node.childIdx + node.numPrimitives);
+    node.childIdx = offset;
+  }
+
+  // each subtree's root takes its shard's place, the rest goes at the end
+  for (uint i=0;i<m_shards.size();i++) {
+    const Shard &shard = m_shards[i];
+    uint nodeBase = m_nodes.size(), itemBase = items.size();
+    for (uint j=0;j<shard.items.size();j++) {
+      items.push_back(shard.triangles[shard.items[j]]);
+    }
+    for (uint j=0;j<shard.nodes.size();j++) {
+      MantaKDTreeNode node = shard.nodes[j];
+      if (node.isLeaf) {
+        node.childIdx += itemBase;
+      } else {
+        node.childIdx += nodeBase - 1; // the root isn't appended
+      }
+      if (j == 0) {
+        m_nodes[shard.nodeIdx] = node;
+      } else {
+        m_nodes.push_back(node);
+      }
+    }
+  }
+  m_items.swap(items);
+}
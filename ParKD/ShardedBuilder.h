@@ -0,0 +1,126 @@
+/*
+   Copyright (c) 2010 University of Illinois
+   All rights reserved.
+
+   Developed by:           DeNovo group, Graphis@Illinois
+                           University of Illinois
+                           http://denovo.cs.illinois.edu
+                           http://graphics.cs.illinois.edu
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   "Software"), to deal with the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimers.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following disclaimers
+      in the documentation and/or other materials provided with the
+      distribution.
+
+    * Neither the names of DeNovo group, Graphics@Illinois, 
+      University of Illinois, nor the names of its contributors may be used to 
+      endorse or promote products derived from this Software without specific 
+      prior written permission.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+   OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+   MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+   IN NO EVENT SHALL THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+   ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+   TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+   SOFTWARE OR THE USE OR OTHER DEALINGS WITH THE SOFTWARE.
+*/
+
+#ifndef _SHARDEDBUILDER_H_
+#define _SHARDEDBUILDER_H_
+
+#include <string>
+#include <vector>
+
+#include <sched.h>
+#include <sys/types.h>
+
+#include <tbb/atomic.h>
+
+#include "BuildOptions.h"
+#include "KdTreeBuilder.h"
+#include "TriangleMesh.h"
+#include "BoundingBox.h"
+#include "MantaKDTreeNode.h"
+
+// Builds one tree over several processes (parkd --shards <k>), for
+// machines where a single pool stops scaling past a socket.
+//
+// This process builds the top k levels itself. Every leaf left open at
+// depth k becomes a shard: its triangles go into POSIX shared memory as a
+// .blob, and a worker builds the remaining levels over them. There is one
+// worker per NUMA node, a parkd --serve child pinned to the node's CPUs
+// (protocol in BuildServer.h), so each subtree is built and first touched
+// on one node. The subtrees come back in shared memory and are grafted
+// onto the top levels as one tree in writeToFile()'s layout.
+//
+// The workers see each shard as a mesh of its own, bounded by its
+// triangles rather than by the cell it came from, so below depth k the
+// splits can differ from those of a single-process build.
+class ShardedBuilder {
+public:
+  ShardedBuilder(const BuildOptions &options, uint shardLevels, bool quiet);
+  ~ShardedBuilder(); // stops the workers
+
+  // false (after saying why) if any part failed
+  bool build(KdTreeBuilder &builder, const TriangleMesh &mesh);
+
+  const std::vector<int> &items() const { return m_items; }
+  const std::vector<MantaKDTreeNode> &nodes() const { return m_nodes; }
+  const BoundingBox &extent() const { return m_extent; }
+  uint numShards() const { return m_shards.size(); }
+
+  // per-stage times of the last build, in microseconds
+  long int topUsec, shardsUsec, stitchUsec;
+
+  // one worker's request loop (see build)
+  void dispatch(uint worker);
+
+private:
+  struct Shard {
+    uint nodeIdx;                 // leaf of the top levels it replaces
+    std::vector<int> triangles;   // its triangles, in the worker's order
+    std::vector<int> items;       // the subtree, indices into triangles
+    std::vector<MantaKDTreeNode> nodes;
+    std::string error;
+
+    bool operator<(const Shard &rhs) const {
+      return triangles.size() > rhs.triangles.size();
+    }
+  };
+
+  bool startWorkers(const std::vector<cpu_set_t> &nodeCpus, uint count);
+  void stopWorkers();
+  // false if the connection is lost; the shard's error says how it went
+  bool buildShard(int fd, uint worker, Shard &shard);
+  void stitch();
+
+  const BuildOptions m_options;
+  const uint m_shardLevels;
+  const bool m_quiet;
+  const TriangleMesh *m_mesh;
+
+  std::vector<pid_t> m_workers;
+  std::vector<std::string> m_sockets;
+  std::vector<uint> m_workerThreads;
+
+  std::vector<Shard> m_shards;
+  tbb::atomic<uint> m_next;
+
+  BoundingBox m_extent;
+  std::vector<int> m_items;
+  std::vector<MantaKDTreeNode> m_nodes;
+};
+
+#endif // _SHARDEDBUILDER_H_
@@ -44,6 +44,7 @@
 
 #include "ParallelMerge.h"
 #include "config.h"
+#include "Tracer.h"
 
 template<typename RandomAccessIterator, typename Compare>
 class MergeSort : public tbb::task {
@@ -54,12 +55,15 @@ public:
 	// second array (B) - to save the result
 	RandomAccessIterator begin2, end2;
 	const Compare& cmp;
+	Tracer *tracer;
 
 	MergeSort(RandomAccessIterator begin_, 
               RandomAccessIterator end_, 
               RandomAccessIterator begin2_, 
-              RandomAccessIterator end2_, const Compare& cmp_) : 
-      begin1(begin_), end1(end_), begin2(begin2_), end2(end2_), cmp(cmp_) {}
+              RandomAccessIterator end2_, const Compare& cmp_,
+              Tracer *tracer_ = NULL) : 
+      begin1(begin_), end1(end_), begin2(begin2_), end2(end2_), cmp(cmp_),
+      tracer(tracer_) {}
 	task* execute() {
 
 		// actual size = (end-begin+1);
@@ -67,12 +71,13 @@ public:
 
 		// parallel merge sort
 		if (size <= MIN_SIZE) {
+			TraceScope trace(tracer, "sort", -1, -1, size);
 			std::sort(begin1, end1, cmp);
 		}
 		else {
 			// get quarter size
 			int q = size / 4;
-			int* idxs = new int[4];
+			int idxs[4];
 			idxs[0] = q;
 			idxs[1] = 2*q;
 			idxs[2] = 3*q;
@@ -83,7 +88,7 @@ public:
 			set_ref_count(5);
 			// spawn tasks to process each quarter of the array
 			for (int i=0;i<4;i++) {
-				MergeSort& m = *new(allocate_child()) MergeSort(begin1+(i==0 ? 0 : idxs[i-1]), begin1+idxs[i], begin2+(i==0 ? 0 : idxs[i-1]), begin2+idxs[i], cmp);
+				MergeSort& m = *new(allocate_child()) MergeSort(begin1+(i==0 ? 0 : idxs[i-1]), begin1+idxs[i], begin2+(i==0 ? 0 : idxs[i-1]), begin2+idxs[i], cmp, tracer);
 				if (i == 3)
 					spawn_and_wait_for_all(m);
 				else
@@ -92,8 +97,8 @@ public:
 
 			
 			// parrallel merge
-			ParallelMerge<RandomAccessIterator, Compare>& pm1 = *new(allocate_child()) ParallelMerge<RandomAccessIterator, Compare>(begin1, begin1+idxs[0], begin1+idxs[0], begin1+idxs[1], begin2, begin2+idxs[1], cmp);
-			ParallelMerge<RandomAccessIterator, Compare>& pm2 = *new(allocate_child()) ParallelMerge<RandomAccessIterator, Compare>(begin1+idxs[1], begin1+idxs[2], begin1+idxs[2], end1, begin2+idxs[1], end2, cmp);
+			ParallelMerge<RandomAccessIterator, Compare>& pm1 = *new(allocate_child()) ParallelMerge<RandomAccessIterator, Compare>(begin1, begin1+idxs[0], begin1+idxs[0], begin1+idxs[1], begin2, begin2+idxs[1], cmp, tracer);
+			ParallelMerge<RandomAccessIterator, Compare>& pm2 = *new(allocate_child()) ParallelMerge<RandomAccessIterator, Compare>(begin1+idxs[1], begin1+idxs[2], begin1+idxs[2], end1, begin2+idxs[1], end2, cmp, tracer);
 
 			set_ref_count(3);
 			spawn(pm1);
@@ -103,7 +108,7 @@ public:
 			// sequential (1) merge of the two from the previous parallel merge
 			sequentialMerge(begin2, begin2+idxs[1], begin2+idxs[1], end2, begin1, cmp);
 			*/
-			ParallelMerge<RandomAccessIterator, Compare>& pm3 = *new(allocate_child()) ParallelMerge<RandomAccessIterator, Compare>(begin2, begin2+idxs[1], begin2+idxs[1], end2, begin1, end1, cmp);
+			ParallelMerge<RandomAccessIterator, Compare>& pm3 = *new(allocate_child()) ParallelMerge<RandomAccessIterator, Compare>(begin2, begin2+idxs[1], begin2+idxs[1], end2, begin1, end1, cmp, tracer);
 			set_ref_count(2);
 			spawn_and_wait_for_all(pm3);
 /*
@@ -43,6 +43,7 @@
 #include <tbb/task.h>
 
 #include "config.h"
+#include "Tracer.h"
 
 template<typename RandomAccessIterator, typename Compare>
 class ParallelMerge : public tbb::task {
@@ -51,6 +52,7 @@ public:
 	RandomAccessIterator begin1, begin2, begin3;
 	RandomAccessIterator end1, end2, end3;
 	const Compare& cmp;
+	Tracer *tracer;
 
 	ParallelMerge(RandomAccessIterator begin1_, 
                   RandomAccessIterator end1_, 
@@ -58,15 +60,17 @@ public:
                   RandomAccessIterator end2_, 
                   RandomAccessIterator begin3_, 
                   RandomAccessIterator end3_, 
-                  const Compare& cmp_) : 
+                  const Compare& cmp_,
+                  Tracer *tracer_ = NULL) : 
       begin1(begin1_), begin2(begin2_), begin3(begin3_), end1(end1_), 
-      end2(end2_), end3(end3_), cmp(cmp_) {}
+      end2(end2_), end3(end3_), cmp(cmp_), tracer(tracer_) {}
 	task* execute() {
 
 		size_t size1 = end1 - begin1;
 		size_t size2 = end2 - begin2;
 		size_t size3 = end3 - begin3;
 		if (size1 <= MIN_SIZE || size2 <= MIN_SIZE) {
+			TraceScope trace(tracer, "merge", -1, -1, size1+size2);
 			sequentialMerge(begin1, end1, begin2, end2, begin3, cmp);
 		}
 		else {
@@ -77,10 +81,10 @@ public:
 			// recursively merge in parallel
 			ParallelMerge& pm1 = *new(allocate_child()) 
               ParallelMerge(begin1, begin1+aHalf, begin2, begin2+bSplit, 
-                            begin3, begin3+aHalf+bSplit, cmp);
+                            begin3, begin3+aHalf+bSplit, cmp, tracer);
 			ParallelMerge& pm2 = *new(allocate_child()) 
               ParallelMerge(begin1+aHalf, end1, begin2+bSplit, end2, 
-                            begin3+aHalf+bSplit, end3, cmp);
+                            begin3+aHalf+bSplit, end3, cmp, tracer);
 			set_ref_count(3);
 			spawn(pm1);
 			spawn_and_wait_for_all(pm2);
@@ -73,16 +73,18 @@ template<typename RandomAccessIterator, typename Compare>
 void parallel_mergesort(RandomAccessIterator begin, 
                         RandomAccessIterator end, 
                         RandomAccessIterator begin2, 
-                        RandomAccessIterator end2, const Compare& comp) {
+                        RandomAccessIterator end2, const Compare& comp,
+                        Tracer *tracer = NULL) {
   if (end>begin) {
     
     if (end - begin < MIN_SIZE) {
+      TraceScope trace(tracer, "sort", -1, -1, end-begin);
       std::sort(begin, end, comp);
     }
     else {
       MergeSort<RandomAccessIterator, Compare>& sort = 
         *new(tbb::task::allocate_root()) 
-        MergeSort<RandomAccessIterator, Compare>(begin, end, begin2, end2, comp);
+        MergeSort<RandomAccessIterator, Compare>(begin, end, begin2, end2, comp, tracer);
       tbb::task::spawn_root_and_wait(sort);
     }
   }
@@ -95,9 +97,11 @@ inline void parallel_mergesort(T* begin, T* end, T* begin2, T* end2) {
 }
 
 template<typename RandomAccessIterator>
-inline void parallel_mergesort(RandomAccessIterator begin, RandomAccessIterator end, RandomAccessIterator begin2, RandomAccessIterator end2) {
+inline void parallel_mergesort(RandomAccessIterator begin, RandomAccessIterator end, RandomAccessIterator begin2, RandomAccessIterator end2,
+                               Tracer *tracer = NULL) {
   parallel_mergesort(begin, end, begin2, end2, 
-                     std::less<typename std::iterator_traits<RandomAccessIterator>::value_type>());
+                     std::less<typename std::iterator_traits<RandomAccessIterator>::value_type>(),
+                     tracer);
 }
 
 #endif // _PARALLEL_MERGESORT_H_